@@ -0,0 +1,376 @@
+#ifndef VE281P1_EXTERNAL_SORT_HPP
+#define VE281P1_EXTERNAL_SORT_HPP
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "sort.hpp"
+
+/**
+ * Settings of external_sort
+ * memoryBytes bounds the record buffers of both phases, blockBytes is the size of one read or
+ * write; every open run needs two blocks (one being merged, one being read ahead), so the
+ * merge fan-in is about memoryBytes / (2 * blockBytes) and more runs take extra merge passes.
+ * An empty tempDirectory means $TMPDIR (or $TMP / $TEMP), and the current directory without them.
+ */
+struct ExternalSortOptions {
+    size_t memoryBytes = size_t(256) << 20;
+    size_t blockBytes = size_t(4) << 20;
+    std::string tempDirectory;
+};
+
+namespace ExternalSort {
+    // EFFECTS: owns a FILE * opened unbuffered, since every read and write is a whole block anyway
+    class File {
+    public:
+        File(const std::string &path, const char *mode) : path(path), file(std::fopen(path.c_str(), mode)) {
+            if (!file) throw std::runtime_error("external_sort: cannot open " + path);
+            std::setvbuf(file, nullptr, _IONBF, 0);
+        }
+
+        File(const File &) = delete;
+
+        File &operator=(const File &) = delete;
+
+        ~File() {
+            if (file) std::fclose(file);
+        }
+
+        // EFFECTS: read up to bytes bytes, returns how many were read (less only at the end of the file)
+        size_t read(void *data, size_t bytes) {
+            size_t got = std::fread(data, 1, bytes, file);
+            if (got < bytes && std::ferror(file)) throw std::runtime_error("external_sort: cannot read " + path);
+            return got;
+        }
+
+        void write(const void *data, size_t bytes) {
+            if (bytes && std::fwrite(data, 1, bytes, file) != bytes) {
+                throw std::runtime_error("external_sort: cannot write " + path);
+            }
+        }
+
+        // EFFECTS: close the file and report a failed flush, which the destructor has to swallow
+        void close() {
+            FILE *f = file;
+            file = nullptr;
+            if (std::fclose(f) != 0) throw std::runtime_error("external_sort: cannot close " + path);
+        }
+
+    private:
+        std::string path;
+        FILE *file;
+    };
+
+    // EFFECTS: names unique temporary run files and removes all of them when it goes away
+    class TempFiles {
+    public:
+        explicit TempFiles(std::string directory) : directory(std::move(directory)) {
+            if (this->directory.empty()) {
+                const char *names[] = {"TMPDIR", "TMP", "TEMP"};
+                for (const char *name : names) {
+                    const char *value = std::getenv(name);
+                    if (value && *value) {
+                        this->directory = value;
+                        break;
+                    }
+                }
+                if (this->directory.empty()) this->directory = ".";
+            }
+            std::random_device random;
+            prefix = this->directory + "/ve281_run_" + std::to_string(random()) + "_";
+        }
+
+        TempFiles(const TempFiles &) = delete;
+
+        TempFiles &operator=(const TempFiles &) = delete;
+
+        ~TempFiles() {
+            for (const std::string &path : paths) std::remove(path.c_str());
+        }
+
+        std::string create() {
+            paths.push_back(prefix + std::to_string(paths.size()) + ".bin");
+            return paths.back();
+        }
+
+        void remove(const std::string &path) {
+            std::remove(path.c_str());
+        }
+
+    private:
+        std::string directory;
+        std::string prefix;
+        std::vector<std::string> paths;
+    };
+
+    /**
+     * The one background thread of an external_sort which does all reads ahead and writes behind,
+     * in the order they were submitted; a thread per block would cost a thread start every few
+     * megabytes, and the blocks of one disk are not read any faster in parallel anyway
+     */
+    class IoThread {
+    public:
+        IoThread() : thread([this] { loop(); }) {}
+
+        IoThread(const IoThread &) = delete;
+
+        IoThread &operator=(const IoThread &) = delete;
+
+        ~IoThread() {
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                stopping = true;
+            }
+            wake.notify_one();
+            thread.join();
+        }
+
+        // EFFECTS: queue function, the future holds its result or the exception it threw
+        template<typename Function>
+        std::future<typename std::result_of<Function()>::type> submit(Function function) {
+            typedef typename std::result_of<Function()>::type Result;
+            std::shared_ptr<std::packaged_task<Result()>> task =
+                    std::make_shared<std::packaged_task<Result()>>(std::move(function));
+            std::future<Result> result = task->get_future();
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                tasks.push_back([task] { (*task)(); });
+            }
+            wake.notify_one();
+            return result;
+        }
+
+    private:
+        std::mutex lock;
+        std::condition_variable wake;
+        std::vector<std::function<void()>> tasks;
+        bool stopping = false;
+        std::thread thread;
+
+        void loop() {
+            std::vector<std::function<void()>> running;
+            while (true) {
+                {
+                    std::unique_lock<std::mutex> guard(lock);
+                    wake.wait(guard, [this] { return stopping || !tasks.empty(); });
+                    if (tasks.empty()) return;
+                    running.swap(tasks);
+                }
+                for (std::function<void()> &task : running) task();
+                running.clear();
+            }
+        }
+    };
+
+    /**
+     * Sequential reader of a run file with read-ahead: while the records of one block are
+     * merged, the next block is read on the IoThread into the second buffer
+     */
+    template<typename Record>
+    class RunReader {
+    public:
+        RunReader(const std::string &path, size_t blockRecords, IoThread &io)
+                : file(path, "rb"), io(io), current(blockRecords), ahead(blockRecords) {
+            size = fetch(current);
+            if (size) prefetch();
+        }
+
+        RunReader(const RunReader &) = delete;
+
+        RunReader &operator=(const RunReader &) = delete;
+
+        ~RunReader() {
+            if (pending.valid()) pending.wait();
+        }
+
+        bool empty() const { return position == size; }
+
+        const Record &head() const { return current[position]; }
+
+        // EFFECTS: drop the head, switching to the read-ahead block once the current one is used up
+        void pop() {
+            if (++position < size) return;
+            size = pending.get();
+            current.swap(ahead);
+            position = 0;
+            if (size) prefetch();
+        }
+
+    private:
+        File file;
+        IoThread &io;
+        std::vector<Record> current;
+        std::vector<Record> ahead;
+        size_t position = 0;
+        size_t size = 0;
+        std::future<size_t> pending;
+
+        size_t fetch(std::vector<Record> &buffer) {
+            size_t bytes = file.read(buffer.data(), buffer.size() * sizeof(Record));
+            if (bytes % sizeof(Record)) throw std::runtime_error("external_sort: truncated record in a run");
+            return bytes / sizeof(Record);
+        }
+
+        void prefetch() {
+            pending = io.submit([this] { return fetch(ahead); });
+        }
+    };
+
+    /**
+     * Sequential writer with write-behind: a full block is handed to the IoThread and the
+     * records that follow go into the second buffer meanwhile
+     */
+    template<typename Record>
+    class RunWriter {
+    public:
+        RunWriter(const std::string &path, size_t blockRecords, IoThread &io)
+                : file(path, "wb"), io(io), capacity(blockRecords) {
+            current.reserve(capacity);
+            behind.reserve(capacity);
+        }
+
+        RunWriter(const RunWriter &) = delete;
+
+        RunWriter &operator=(const RunWriter &) = delete;
+
+        ~RunWriter() {
+            if (pending.valid()) pending.wait();
+        }
+
+        void push(const Record &record) {
+            current.push_back(record);
+            if (current.size() == capacity) flush();
+        }
+
+        void finish() {
+            flush();
+            if (pending.valid()) pending.get();
+            file.close();
+        }
+
+    private:
+        File file;
+        IoThread &io;
+        size_t capacity;
+        std::vector<Record> current;
+        std::vector<Record> behind;
+        std::future<void> pending;
+
+        void flush() {
+            if (pending.valid()) pending.get();
+            current.swap(behind);
+            current.clear();
+            if (behind.empty()) return;
+            pending = io.submit([this] { file.write(behind.data(), behind.size() * sizeof(Record)); });
+        }
+    };
+
+    // EFFECTS: k-way merge of the sorted run files inputs into output through a LoserTree over the
+    //          run heads; on ties the record of the earlier run comes first
+    template<typename Record, typename Compare>
+    void merge_runs(const std::vector<std::string> &inputs, const std::string &output, size_t blockRecords,
+                    Compare comp, IoThread &io) {
+        std::vector<std::unique_ptr<RunReader<Record>>> readers;
+        for (const std::string &input : inputs) {
+            readers.emplace_back(new RunReader<Record>(input, blockRecords, io));
+        }
+        auto beats = [&](size_t a, size_t b) {
+            if (readers[a]->empty()) return false;
+            if (readers[b]->empty()) return true;
+            const Record &x = readers[a]->head(), &y = readers[b]->head();
+            return a < b ? !comp(y, x) : comp(x, y);
+        };
+        LoserTree<decltype(beats)> tree(readers.size(), beats);
+        RunWriter<Record> writer(output, blockRecords, io);
+        while (true) {
+            RunReader<Record> &reader = *readers[tree.winner()];
+            if (reader.empty()) break;
+            writer.push(reader.head());
+            reader.pop();
+            tree.replay();
+        }
+        writer.finish();
+    }
+}
+
+/**
+ * Sort a binary file of fixed-size records which need not fit in memory
+ * Phase one reads memoryBytes / 2 at a time, sorts it with quick_sort_inplace and writes it as a
+ * run while the next chunk is read and sorted. Phase two merges up to fan-in runs at a time with
+ * read-ahead and write-behind blocks, repeating until one pass produces output. The background
+ * reads and writes of both phases share one IoThread. input and output may be the same file,
+ * temporary runs go to options.tempDirectory and are always removed.
+ * Not stable. Time complexity: O(n log n) comparisons, O(n log_fanin(runs)) I/O
+ */
+template<typename Record, typename Compare = std::less<Record>>
+void external_sort(const std::string &input, const std::string &output, Compare comp = Compare(),
+                   const ExternalSortOptions &options = ExternalSortOptions()) {
+    static_assert(std::is_trivially_copyable<Record>::value, "external_sort needs trivially copyable records");
+    using namespace ExternalSort;
+    size_t runRecords = options.memoryBytes / 2 / sizeof(Record);
+    size_t blockRecords = std::max<size_t>(options.blockBytes / sizeof(Record), 1);
+    if (runRecords < 2 * blockRecords) {
+        throw std::invalid_argument("external_sort: memoryBytes must hold at least four blocks");
+    }
+    size_t fanIn = std::max<size_t>(options.memoryBytes / (2 * blockRecords * sizeof(Record)), 3) - 1;
+    TempFiles temp(options.tempDirectory);
+    IoThread io;
+    std::vector<std::string> runs;
+    {
+        File in(input, "rb");
+        std::vector<Record> chunk(runRecords), writing(runRecords);
+        std::future<void> pending;
+        try {
+            while (true) {
+                size_t bytes = in.read(chunk.data(), runRecords * sizeof(Record));
+                if (bytes % sizeof(Record)) {
+                    throw std::runtime_error("external_sort: " + input + " has a truncated record");
+                }
+                size_t count = bytes / sizeof(Record);
+                if (count == 0 && !runs.empty()) break;
+                quick_sort_inplace(chunk.data(), chunk.data() + count, comp);
+                if (pending.valid()) pending.get();
+                chunk.swap(writing);
+                runs.push_back(temp.create());
+                std::string path = runs.back();
+                pending = io.submit([&writing, count, path] {
+                    File out(path, "wb");
+                    out.write(writing.data(), count * sizeof(Record));
+                    out.close();
+                });
+                if (count < runRecords) break;
+            }
+        } catch (...) {
+            // unlike the future of std::async, this one does not wait when it goes away, and the
+            // write still reads writing
+            if (pending.valid()) pending.wait();
+            throw;
+        }
+        if (pending.valid()) pending.get();
+    }
+    while (runs.size() > fanIn) {
+        std::vector<std::string> merged;
+        for (size_t first = 0; first < runs.size(); first += fanIn) {
+            std::vector<std::string> group(runs.begin() + first, runs.begin() + std::min(first + fanIn, runs.size()));
+            merged.push_back(temp.create());
+            merge_runs<Record>(group, merged.back(), blockRecords, comp, io);
+            for (const std::string &path : group) temp.remove(path);
+        }
+        runs.swap(merged);
+    }
+    merge_runs<Record>(runs, output, blockRecords, comp, io);
+}
+
+#endif //VE281P1_EXTERNAL_SORT_HPP
@@ -21,11 +21,15 @@ int dis(const point &p1, const point &p2) {
     return (((p1.x - p2.x) * (p1.x - p2.x) + (p1.y - p2.y) * (p1.y - p2.y)));
 }
 
-class angleSort{
+// polar angle around p0 (p0 is the lowest point, so the angles are in [0, pi)) as a key computed
+// once per point: -dx / (|dx| + dy) grows with the angle and is exact enough for int coordinates
+// that collinear points get equal keys; farther points come first on the same ray
+class angleKey{
 public:
     point p0;
-    bool operator ()(point &x,point &y) const{
-        return((ccw(p0,x,y)>0)||(ccw(p0,x,y)==0&& dis(p0,x)> dis(p0,y)));
+    tuple<double,int> operator ()(const point &p) const{
+        int dx = p.x - p0.x, dy = p.y - p0.y;
+        return make_tuple(-dx / (double)(abs(dx) + dy), -dis(p0,p));
     }
 };
 
@@ -87,8 +91,7 @@ void simplify(point &p0, set &X) {
 void selectConvex(set &X,set &S){
     if ((int)X.size()==0) return ;
     point p0 = get_p0(X);
-    angleSort cmp={p0};
-    sort(X.begin() + 1, X.end(), cmp);
+    sort_by_key(X.begin() + 1, X.end(), angleKey{p0});
     simplify(p0,X);
     for (auto & it : X) {
         while (S.size() > 1 && ccw(S[S.size() - 2], S.back(), it) <= 0) {
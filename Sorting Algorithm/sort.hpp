@@ -3,179 +3,3051 @@
 
 #include <vector>
 #include <cstdlib>
+#include <chrono>
+#include <cmath>
 #include <functional>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <stdexcept>
+#include <mutex>
+#include <random>
+#include <type_traits>
+#include "sort_network.hpp"
+#include "thread_pool.hpp"
 
-using namespace std;
-
+// EFFECTS: swap through the element type's own swap if it has one (found by ADL), std::swap
+//          otherwise, which moves instead of copying and needs no default constructor
 template<class T>
 void mySwap(T &a, T &b) {
-    T temp;
-    temp = a;
-    a = b;
-    b = temp;
+    using std::swap;
+    swap(a, b);
 }
 
+// EFFECTS: whether RandomIt walks consecutive memory (a pointer or a std::vector iterator), so the
+//          kernels which need a T * (SIMD networks and merges, branch-free partitions) can run on it
+template<typename RandomIt, typename T = typename std::iterator_traits<RandomIt>::value_type>
+struct contiguous_iterator : std::integral_constant<bool, std::is_pointer<RandomIt>::value || (
+        !std::is_same<T, bool>::value && std::is_same<RandomIt, typename std::vector<T>::iterator>::value)> {
+};
 
-template<typename T, typename Compare>
-void bubble_sort(std::vector<T> &vector, Compare comp = std::less<T>()) {
-    // TODO: implement
-    int size = static_cast<int> (vector.size());
+template<typename RandomIt>
+RandomIt unwrap_iterator(RandomIt it, std::false_type) {
+    return it;
+}
+
+template<typename RandomIt>
+typename std::iterator_traits<RandomIt>::value_type *unwrap_iterator(RandomIt it, std::true_type) {
+    return std::addressof(*it);
+}
+
+// EFFECTS: a pointer to *it if RandomIt is contiguous, otherwise it itself, so that a vector and a
+//          raw buffer share one instantiation of every kernel; it must be dereferenceable
+template<typename RandomIt>
+auto unwrap_iterator(RandomIt it) -> decltype(unwrap_iterator(it, contiguous_iterator<RandomIt>())) {
+    return unwrap_iterator(it, contiguous_iterator<RandomIt>());
+}
+
+// EFFECTS: a buffer of last - first elements whose values are meant to be overwritten; types without a
+//          default constructor are moved in and straight back, which leaves moved-from elements behind
+template<typename RandomIt>
+std::vector<typename std::iterator_traits<RandomIt>::value_type> scratch_buffer(RandomIt first, RandomIt last,
+                                                                                 std::true_type) {
+    return std::vector<typename std::iterator_traits<RandomIt>::value_type>(last - first);
+}
+
+template<typename RandomIt>
+std::vector<typename std::iterator_traits<RandomIt>::value_type> scratch_buffer(RandomIt first, RandomIt last,
+                                                                                 std::false_type) {
+    std::vector<typename std::iterator_traits<RandomIt>::value_type> scratch(std::make_move_iterator(first),
+                                                                              std::make_move_iterator(last));
+    std::move(scratch.begin(), scratch.end(), first);
+    return scratch;
+}
+
+template<typename RandomIt>
+std::vector<typename std::iterator_traits<RandomIt>::value_type> scratch_buffer(RandomIt first, RandomIt last) {
+    return scratch_buffer(first, last,
+                          std::is_default_constructible<typename std::iterator_traits<RandomIt>::value_type>());
+}
+
+// EFFECTS: the SIMD kernels of sort_network.hpp only take pointers, other iterators (std::deque)
+//          always get false / nullptr and take the scalar path
+template<typename RandomIt, typename Compare>
+bool simd_network_sort(RandomIt, int, Compare) {
+    return false;
+}
+
+template<typename RandomIt, typename Compare>
+bool simd_network_stable_sort(RandomIt, int, Compare) {
+    return false;
+}
+
+template<typename T, typename RandomIt, typename Compare>
+bool simd_merge(const T *, const T *, const T *, const T *, RandomIt, Compare) {
+    return false;
+}
+
+// phases an instrumentation policy can time, see TimingSortMetrics
+enum class SortPhase {
+    Scratch, Partition, Merge, Leaf
+};
+
+const int SORT_PHASES = 4;
+
+/**
+ * Instrumentation policy of the six sorts, the default one: every hook is empty, the comparator is
+ * passed on untouched and the helpers take this empty struct by value, so an uninstrumented sort
+ * passes nothing extra down its recursion (see SortMetricsRef).
+ * A policy is told about a call (begin / end), each comparison, element move and swap, every
+ * recursive call (enter / leave), the sizes of the two sides of every partition and the start and
+ * end of every phase; the instrumented overloads of the sorts take a policy as their last argument.
+ */
+struct NoSortMetrics {
+    void begin(const char *, size_t) {}
+
+    void end() {}
+
+    void compare() {}
+
+    void move(size_t) {}
+
+    void swap() {}
+
+    void enter() {}
+
+    void leave() {}
+
+    void partition(size_t, size_t) {}
+
+    void phase_begin(SortPhase) {}
+
+    void phase_end(SortPhase) {}
+};
+
+/**
+ * What CountingSortMetrics / TimingSortMetrics measured in one sort call
+ * imbalance of a partition: |left - right| / (left + right) of its two sides, 0 is an even split
+ * and 1 a pivot at the border; seconds are only filled in by TimingSortMetrics
+ */
+struct SortMetrics {
+    const char *algorithm = "";
+    size_t size = 0;
+    uint64_t comparisons = 0;
+    uint64_t moves = 0;
+    uint64_t swaps = 0;
+    int maxDepth = 0;
+    uint64_t partitions = 0;
+    double maxImbalance = 0;
+    double totalImbalance = 0;
+    double seconds = 0;
+    double phaseSeconds[SORT_PHASES] = {};
+
+    double meanImbalance() const { return partitions ? totalImbalance / (double) partitions : 0; }
+};
+
+// receives the metrics of every instrumented call when it ends
+typedef std::function<void(const SortMetrics &)> SortMetricsSink;
+
+/**
+ * Counts comparisons, moves, swaps, recursion depth and partition imbalance of each call and hands
+ * them to the sink when the call ends; metrics() holds the last call. Comparisons are counted by
+ * wrapping the comparator, which also keeps the SIMD networks and branch-free partitions (whose
+ * comparisons cannot be counted) out of the run. Not thread safe: the parallel paths of
+ * quick_sort_extra are off when it is instrumented.
+ */
+class CountingSortMetrics {
+public:
+    explicit CountingSortMetrics(SortMetricsSink sink = SortMetricsSink()) : sink(std::move(sink)) {}
+
+    void begin(const char *algorithm, size_t size) {
+        current = SortMetrics();
+        current.algorithm = algorithm;
+        current.size = size;
+        depth = 0;
+    }
+
+    void end() {
+        if (sink) sink(current);
+    }
+
+    void compare() { current.comparisons++; }
+
+    void move(size_t count) { current.moves += count; }
+
+    void swap() { current.swaps++; }
+
+    void enter() {
+        if (++depth > current.maxDepth) current.maxDepth = depth;
+    }
+
+    void leave() { depth--; }
+
+    void partition(size_t left, size_t right) {
+        double imbalance = left + right ? std::fabs((double) left - (double) right) / (double) (left + right) : 0;
+        current.partitions++;
+        current.totalImbalance += imbalance;
+        current.maxImbalance = std::max(current.maxImbalance, imbalance);
+    }
+
+    void phase_begin(SortPhase) {}
+
+    void phase_end(SortPhase) {}
+
+    const SortMetrics &metrics() const { return current; }
+
+protected:
+    SortMetrics current;
+    int depth = 0;
+    SortMetricsSink sink;
+};
+
+/**
+ * CountingSortMetrics plus the time of the whole call and of every phase: Scratch is allocating
+ * (or gathering into) the buffers, Partition the partition steps of the quick sorts including
+ * pivot selection, Merge the merges of merge_sort and Leaf the small sorts the quick sorts end in.
+ * Each phase costs two clock reads, which small partitions and merges notice.
+ */
+class TimingSortMetrics : public CountingSortMetrics {
+public:
+    using CountingSortMetrics::CountingSortMetrics;
+
+    void begin(const char *algorithm, size_t size) {
+        CountingSortMetrics::begin(algorithm, size);
+        started = std::chrono::steady_clock::now();
+    }
+
+    void end() {
+        current.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        CountingSortMetrics::end();
+    }
+
+    void phase_begin(SortPhase phase) { phaseStarted[(int) phase] = std::chrono::steady_clock::now(); }
+
+    void phase_end(SortPhase phase) {
+        current.phaseSeconds[(int) phase] += std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - phaseStarted[(int) phase]).count();
+    }
+
+private:
+    std::chrono::steady_clock::time_point started;
+    std::chrono::steady_clock::time_point phaseStarted[SORT_PHASES];
+};
+
+// EFFECTS: comp, which reports every comparison to the policy
+template<typename Compare, typename Policy>
+struct counting_compare {
+    Compare comp;
+    Policy *policy;
+
+    template<typename A, typename B>
+    bool operator()(const A &a, const B &b) const {
+        policy->compare();
+        return comp(a, b);
+    }
+};
+
+template<typename Compare>
+Compare instrument_compare(Compare comp, NoSortMetrics &) {
+    return comp;
+}
+
+template<typename Compare, typename Policy>
+counting_compare<Compare, Policy> instrument_compare(Compare comp, Policy &policy) {
+    return counting_compare<Compare, Policy>{comp, &policy};
+}
+
+// EFFECTS: the hooks of *policy. The helpers take their policy by value: an instrumented call hands
+//          them this one pointer, an uninstrumented one the empty NoSortMetrics, which is passed in
+//          no register or stack slot, so the recursive helpers keep the frames they had without hooks
+template<typename Policy>
+struct SortMetricsRef {
+    Policy *policy;
+
+    void begin(const char *algorithm, size_t size) const { policy->begin(algorithm, size); }
+
+    void end() const { policy->end(); }
+
+    void compare() const { policy->compare(); }
+
+    void move(size_t count) const { policy->move(count); }
+
+    void swap() const { policy->swap(); }
+
+    void enter() const { policy->enter(); }
+
+    void leave() const { policy->leave(); }
+
+    void partition(size_t left, size_t right) const { policy->partition(left, right); }
+
+    void phase_begin(SortPhase phase) const { policy->phase_begin(phase); }
+
+    void phase_end(SortPhase phase) const { policy->phase_end(phase); }
+};
+
+inline NoSortMetrics metrics_ref(NoSortMetrics &) {
+    return NoSortMetrics();
+}
+
+template<typename Policy>
+SortMetricsRef<Policy> metrics_ref(Policy &policy) {
+    return SortMetricsRef<Policy>{&policy};
+}
+
+// EFFECTS: tells the policy about one level of recursion for as long as it lives
+template<typename Policy>
+struct SortRecursion {
+    Policy policy;
+
+    explicit SortRecursion(Policy policy) : policy(policy) { policy.enter(); }
+
+    ~SortRecursion() { policy.leave(); }
+};
+
+template<typename Policy>
+struct SortPhaseScope {
+    Policy policy;
+    SortPhase phase;
+
+    SortPhaseScope(Policy policy, SortPhase phase) : policy(policy), phase(phase) { policy.phase_begin(phase); }
+
+    ~SortPhaseScope() { policy.phase_end(phase); }
+};
+
+template<typename T, typename Policy>
+void policy_swap(T &a, T &b, Policy policy) {
+    mySwap(a, b);
+    policy.swap();
+}
+
+template<typename RandomIt, typename Compare, typename Policy>
+void bubble_sort_helper(RandomIt first, RandomIt last, Compare comp, Policy policy) {
+    ptrdiff_t size = last - first;
     bool flag = true;
     if (size < 2) return;
-    else {
-        for (int i = 0; i < size - 1 && flag; i++) {
-            flag = false;
-            for (int j = 0; j < size - i - 1; j++) {
-                if (comp(vector[j + 1], vector[j])) {
-                    mySwap(vector[j], vector[j + 1]);
-                    flag = true;
-                }
+    for (ptrdiff_t i = 0; i < size - 1 && flag; i++) {
+        flag = false;
+        for (ptrdiff_t j = 0; j < size - i - 1; j++) {
+            if (comp(first[j + 1], first[j])) {
+                policy_swap(first[j], first[j + 1], policy);
+                flag = true;
             }
         }
     }
 }
 
+template<typename RandomIt, typename Compare = std::less<typename std::iterator_traits<RandomIt>::value_type>>
+void bubble_sort(RandomIt first, RandomIt last, Compare comp = Compare()) {
+    NoSortMetrics none;
+    bubble_sort_helper(first, last, comp, none);
+}
+
+// EFFECTS: bubble_sort reporting to policy, see NoSortMetrics
+template<typename RandomIt, typename Compare, typename Policy>
+void bubble_sort(RandomIt first, RandomIt last, Compare comp, Policy &policy) {
+    policy.begin("bubble_sort", (size_t) (last - first));
+    bubble_sort_helper(first, last, instrument_compare(comp, policy), metrics_ref(policy));
+    policy.end();
+}
+
 template<typename T, typename Compare>
-void insertion_sort(std::vector<T> &vector, Compare comp = std::less<T>()) {
-    // TODO: implement
-    size_t size = vector.size();
-    for (int i = 0; i < (int) size; i++) {
-        T temp = vector[i];
-        int index = i - 1;
-        while (index >= 0 && comp(temp, vector[index])) {
-            vector[index + 1] = vector[index];
+void bubble_sort(std::vector<T> &vector, Compare comp = std::less<T>()) {
+    bubble_sort(vector.begin(), vector.end(), comp);
+}
+
+template<typename T, typename Compare, typename Policy>
+void bubble_sort(std::vector<T> &vector, Compare comp, Policy &policy) {
+    bubble_sort(vector.begin(), vector.end(), comp, policy);
+}
+
+// EFFECTS: stable insertion sort of [first, last)
+template<typename RandomIt, typename Compare, typename Policy>
+void insertion_sort_helper(RandomIt first, RandomIt last, Compare comp, Policy policy) {
+    typedef typename std::iterator_traits<RandomIt>::value_type T;
+    if (last - first < 2) return;
+    for (RandomIt i = first + 1; i < last; i++) {
+        if (!comp(*i, *(i - 1))) continue;
+        T temp = std::move(*i);
+        RandomIt index = i;
+        do {
+            *index = std::move(*(index - 1));
             index--;
-        }
-        vector[index + 1] = temp;
+        } while (index != first && comp(temp, *(index - 1)));
+        *index = std::move(temp);
+        policy.move((size_t) (i - index) + 2);
     }
 }
 
+template<typename RandomIt, typename Compare = std::less<typename std::iterator_traits<RandomIt>::value_type>>
+void insertion_sort(RandomIt first, RandomIt last, Compare comp = Compare()) {
+    NoSortMetrics none;
+    insertion_sort_helper(first, last, comp, none);
+}
+
+template<typename RandomIt, typename Compare, typename Policy>
+void insertion_sort(RandomIt first, RandomIt last, Compare comp, Policy &policy) {
+    policy.begin("insertion_sort", (size_t) (last - first));
+    insertion_sort_helper(first, last, instrument_compare(comp, policy), metrics_ref(policy));
+    policy.end();
+}
+
 template<typename T, typename Compare>
-void selection_sort(std::vector<T> &vector, Compare comp = std::less<T>()) {
-    // TODO: implement
-    int left = 0;
-    int right = (int) vector.size() - 1;
+void insertion_sort(std::vector<T> &vector, int left, int right, Compare comp = std::less<T>()) {
+    if (left < right) insertion_sort(vector.begin() + left, vector.begin() + right + 1, comp);
+}
+
+template<typename T, typename Compare>
+void insertion_sort(std::vector<T> &vector, Compare comp = std::less<T>()) {
+    insertion_sort(vector.begin(), vector.end(), comp);
+}
+
+template<typename T, typename Compare, typename Policy>
+void insertion_sort(std::vector<T> &vector, Compare comp, Policy &policy) {
+    insertion_sort(vector.begin(), vector.end(), comp, policy);
+}
+
+template<typename RandomIt, typename Compare, typename Policy>
+void selection_sort_helper(RandomIt first, RandomIt last, Compare comp, Policy policy) {
+    ptrdiff_t left = 0;
+    ptrdiff_t right = last - first - 1;
     while (left < right) {
-        int min = left;
-        int max = right;
-        for (int i = left; i < right + 1; i++) {
-            if (comp(vector[i], vector[min])) {
+        ptrdiff_t min = left;
+        ptrdiff_t max = right;
+        for (ptrdiff_t i = left; i < right + 1; i++) {
+            if (comp(first[i], first[min])) {
                 min = i;
             }
-            if (!comp(vector[i], vector[max])) {
+            if (!comp(first[i], first[max])) {
                 max = i;
             }
         }
-        mySwap(vector[max], vector[right]);
+        policy_swap(first[max], first[right], policy);
         if (min == right) min = max;
-        mySwap(vector[min], vector[left]);
+        policy_swap(first[min], first[left], policy);
         left++;
         right--;
     }
 }
 
+template<typename RandomIt, typename Compare = std::less<typename std::iterator_traits<RandomIt>::value_type>>
+void selection_sort(RandomIt first, RandomIt last, Compare comp = Compare()) {
+    NoSortMetrics none;
+    selection_sort_helper(first, last, comp, none);
+}
+
+template<typename RandomIt, typename Compare, typename Policy>
+void selection_sort(RandomIt first, RandomIt last, Compare comp, Policy &policy) {
+    policy.begin("selection_sort", (size_t) (last - first));
+    selection_sort_helper(first, last, instrument_compare(comp, policy), metrics_ref(policy));
+    policy.end();
+}
+
 template<typename T, typename Compare>
-void merge(std::vector<T> &vector, T newVec[], int front, int mid, int end, Compare comp = std::less<T>()) {
-    int i = front;
-    int j = mid + 1;
-    for (int k = front; k <= end; k++) {
-        newVec[k] = vector[k];
+void selection_sort(std::vector<T> &vector, Compare comp = std::less<T>()) {
+    selection_sort(vector.begin(), vector.end(), comp);
+}
+
+template<typename T, typename Compare, typename Policy>
+void selection_sort(std::vector<T> &vector, Compare comp, Policy &policy) {
+    selection_sort(vector.begin(), vector.end(), comp, policy);
+}
+
+// EFFECTS: merge the sorted data[front..mid] and data[mid + 1..end] through newVec
+template<typename RandomIt, typename T, typename Compare, typename Policy>
+void merge_halves(RandomIt data, T newVec[], ptrdiff_t front, ptrdiff_t mid, ptrdiff_t end, Compare comp,
+                  Policy policy) {
+    SortPhaseScope<Policy> phase(policy, SortPhase::Merge);
+    ptrdiff_t i = front;
+    ptrdiff_t j = mid + 1;
+    for (ptrdiff_t k = front; k <= end; k++) {
+        newVec[k] = std::move(data[k]);
     }
-    for (int k = front; k <= end; k++) {
+    policy.move(2 * (size_t) (end - front + 1));
+    if (simd_merge(newVec + front, newVec + mid + 1, newVec + mid + 1, newVec + end + 1, data + front, comp))
+        return;
+    for (ptrdiff_t k = front; k <= end; k++) {
         if (i > mid) {
-            vector[k] = newVec[j++];
+            data[k] = std::move(newVec[j++]);
         } else if (j > end) {
-            vector[k] = newVec[i++];
+            data[k] = std::move(newVec[i++]);
         } else if (comp(newVec[j], newVec[i])) {
-            vector[k] = newVec[j++];
-        } else vector[k] = newVec[i++];
+            data[k] = std::move(newVec[j++]);
+        } else data[k] = std::move(newVec[i++]);
     }
 }
 
+template<typename RandomIt, typename T, typename Compare>
+void merge_halves(RandomIt data, T newVec[], ptrdiff_t front, ptrdiff_t mid, ptrdiff_t end, Compare comp) {
+    NoSortMetrics none;
+    merge_halves(data, newVec, front, mid, end, comp, none);
+}
+
 template<typename T, typename Compare>
-void merge_sort(std::vector<T> &vector, T newVec[], int front, int end, Compare comp = std::less<T>()) {
+void merge(std::vector<T> &vector, T newVec[], int front, int mid, int end, Compare comp = std::less<T>()) {
+    merge_halves(vector.data(), newVec, front, mid, end, comp);
+}
+
+template<typename RandomIt, typename T, typename Compare, typename Policy>
+void merge_sort(RandomIt data, T newVec[], ptrdiff_t front, ptrdiff_t end, Compare comp, Policy policy) {
     if (front >= end)
         return;
-    int mid = (front + end) / 2;
-    merge_sort(vector, newVec, front, mid, comp);
-    merge_sort(vector, newVec, mid + 1, end, comp);
-    merge(vector, newVec, front, mid, end, comp);
+    if (end - front < SIMD_NETWORK_MAX && simd_network_stable_sort(data + front, (int) (end - front + 1), comp))
+        return;
+    SortRecursion<Policy> recursion(policy);
+    ptrdiff_t mid = front + (end - front) / 2;
+    merge_sort(data, newVec, front, mid, comp, policy);
+    merge_sort(data, newVec, mid + 1, end, comp, policy);
+    merge_halves(data, newVec, front, mid, end, comp, policy);
+}
+
+template<typename RandomIt, typename T, typename Compare>
+void merge_sort(RandomIt data, T newVec[], ptrdiff_t front, ptrdiff_t end, Compare comp) {
+    NoSortMetrics none;
+    merge_sort(data, newVec, front, end, comp, none);
+}
+
+template<typename RandomIt, typename Compare, typename Policy>
+void merge_sort_helper(RandomIt first, RandomIt last, Compare comp, Policy policy) {
+    ptrdiff_t size = last - first;
+    if (size < 2) return;
+    policy.phase_begin(SortPhase::Scratch);
+    auto newVec = scratch_buffer(first, last);
+    policy.phase_end(SortPhase::Scratch);
+    merge_sort(unwrap_iterator(first), newVec.data(), 0, size - 1, comp, policy);
+}
+
+template<typename RandomIt, typename Compare = std::less<typename std::iterator_traits<RandomIt>::value_type>>
+void merge_sort(RandomIt first, RandomIt last, Compare comp = Compare()) {
+    NoSortMetrics none;
+    merge_sort_helper(first, last, comp, none);
+}
+
+template<typename RandomIt, typename Compare, typename Policy>
+void merge_sort(RandomIt first, RandomIt last, Compare comp, Policy &policy) {
+    policy.begin("merge_sort", (size_t) (last - first));
+    merge_sort_helper(first, last, instrument_compare(comp, policy), metrics_ref(policy));
+    policy.end();
 }
 
 template<typename T, typename Compare>
 void merge_sort(std::vector<T> &vector, Compare comp = std::less<T>()) {
-    // TODO: implement
-    T *newVec = new T[(int) vector.size()];
-    merge_sort(vector, newVec, 0, (int) vector.size() - 1, comp);
-    delete[] newVec;
+    merge_sort(vector.begin(), vector.end(), comp);
+}
+
+template<typename T, typename Compare, typename Policy>
+void merge_sort(std::vector<T> &vector, Compare comp, Policy &policy) {
+    merge_sort(vector.begin(), vector.end(), comp, policy);
 }
 
+// below this many elements a subproblem is sorted / merged on a single thread
+const int PARALLEL_SORT_GRAIN = 1 << 14;
 
+// EFFECTS: stable merge of [a, aEnd) and [b, bEnd) into out, ties are taken from a; the elements
+//          are moved, so the runs are left with moved-from values
 template<typename T, typename Compare>
-int partitionE(std::vector<T> &vector, int left, int right, Compare comp = std::less<T>()) {
-    std::vector<T> newVector(right - left + 1);
-    int l = left;
-    int r = right;
-    int index = (left + right) / 2;
-    mySwap(vector[left], vector[index]);
-    int position = left + 1;
-    while (position <= right) {
-        if (comp(vector[position], vector[left])) {
-            newVector[l - left] = vector[position];
-            l++;
-        } else {
-            newVector[r - left] = vector[position];
-            r--;
-        }
-        position++;
-    }
-    newVector[l - left] = vector[left];
-    for (int i = left; i <= right; i++) {
-        vector[i] = newVector[i - left];
+void merge_range(T *a, T *aEnd, T *b, T *bEnd, T *out, Compare comp) {
+    if (simd_merge(a, aEnd, b, bEnd, out, comp)) return;
+    while (a != aEnd && b != bEnd) {
+        if (comp(*b, *a)) *out++ = std::move(*b++);
+        else *out++ = std::move(*a++);
     }
-    return l;
+    std::move(b, bEnd, std::move(a, aEnd, out));
 }
 
+// EFFECTS: merge path search, returns how many of the first diag outputs of
+//          merge_range(a, b) come from a
 template<typename T, typename Compare>
-void quick_sort_extra_helper(std::vector<T> &vector, int left, int right, Compare comp = std::less<T>()) {
-    if (left >= right) return;
-    int pivot = partitionE(vector, left, right, comp);
-    quick_sort_extra_helper(vector, left, pivot - 1, comp);
-    quick_sort_extra_helper(vector, pivot + 1, right, comp);
+ptrdiff_t merge_path_split(const T *a, ptrdiff_t na, const T *b, ptrdiff_t nb, ptrdiff_t diag, Compare comp) {
+    ptrdiff_t lo = diag > nb ? diag - nb : 0;
+    ptrdiff_t hi = diag < na ? diag : na;
+    while (lo < hi) {
+        ptrdiff_t mid = lo + (hi - lo) / 2;
+        if (comp(b[diag - mid - 1], a[mid])) hi = mid;
+        else lo = mid + 1;
+    }
+    return lo;
 }
 
+// EFFECTS: merge_range split into independent pieces of equal output length; all splits are
+//          searched before any piece starts, since merging moves elements out of the runs
+template<typename T, typename Compare>
+void parallel_merge(T *a, ptrdiff_t na, T *b, ptrdiff_t nb, T *out, Compare comp, WorkStealingPool &pool) {
+    ptrdiff_t total = na + nb;
+    ptrdiff_t pieces = std::min(total / PARALLEL_SORT_GRAIN, (ptrdiff_t) pool.size() * 4);
+    if (pieces < 2) {
+        merge_range(a, a + na, b, b + nb, out, comp);
+        return;
+    }
+    std::vector<ptrdiff_t> diag(pieces + 1), split(pieces + 1);
+    for (ptrdiff_t p = 0; p <= pieces; p++) {
+        diag[p] = total * p / pieces;
+        split[p] = merge_path_split(a, na, b, nb, diag[p], comp);
+    }
+    TaskGroup group(pool);
+    for (ptrdiff_t p = 0; p < pieces; p++) {
+        group.run([&, p] {
+            merge_range(a + split[p], a + split[p + 1], b + diag[p] - split[p], b + diag[p + 1] - split[p + 1],
+                        out + diag[p], comp);
+        });
+    }
+    group.wait();
+}
 
+// EFFECTS: sort vector[front..end], the result ends up in newVec[front..end] if toBuffer,
+//          otherwise in vector[front..end]; both halves are sorted into the other
+//          array, so every level is a single merge pass without copying back
 template<typename T, typename Compare>
-void quick_sort_extra(std::vector<T> &vector, Compare comp = std::less<T>()) {
-    // TODO: implement
-    quick_sort_extra_helper(vector, 0, (int) vector.size() - 1, comp);
+void parallel_merge_sort_helper(std::vector<T> &vector, T newVec[], ptrdiff_t front, ptrdiff_t end, bool toBuffer,
+                                Compare comp, WorkStealingPool &pool) {
+    if (end - front + 1 <= PARALLEL_SORT_GRAIN) {
+        merge_sort(vector.data(), newVec, front, end, comp);
+        if (toBuffer) {
+            for (ptrdiff_t k = front; k <= end; k++) newVec[k] = std::move(vector[k]);
+        }
+        return;
+    }
+    ptrdiff_t mid = front + (end - front) / 2;
+    TaskGroup group(pool);
+    group.run([&] { parallel_merge_sort_helper(vector, newVec, front, mid, !toBuffer, comp, pool); });
+    parallel_merge_sort_helper(vector, newVec, mid + 1, end, !toBuffer, comp, pool);
+    group.wait();
+    T *source = toBuffer ? vector.data() : newVec;
+    T *target = toBuffer ? newVec : vector.data();
+    parallel_merge(source + front, mid - front + 1, source + mid + 1, end - mid, target + front, comp, pool);
+}
 
+// EFFECTS: stable merge sort which forks both halves on the pool and splits every merge
+//          with merge path, so the last merges are parallel as well
+template<typename T, typename Compare>
+void parallel_merge_sort(std::vector<T> &vector, Compare comp, WorkStealingPool &pool) {
+    if (vector.size() < 2) return;
+    auto newVec = scratch_buffer(vector.begin(), vector.end());
+    parallel_merge_sort_helper(vector, newVec.data(), 0, (ptrdiff_t) vector.size() - 1, false, comp, pool);
 }
 
 template<typename T, typename Compare>
-void quick_sort_inplace_helper(std::vector<T> &vector, int left, int right, Compare comp = std::less<T>()) {
-    if (left >= right) return;
-    T p = vector[left];
-    int i = left, j = right;
-    while (i != j) {
-        while (j > i && !comp(vector[j], p)) {
-            j--;
+void parallel_merge_sort(std::vector<T> &vector, Compare comp = std::less<T>()) {
+    parallel_merge_sort(vector, comp, WorkStealingPool::shared());
+}
+
+/**
+ * Tournament tree of losers over k sources which it only knows by index
+ * Every inner node keeps the source that lost the match played there and node 0 the overall
+ * winner, so once the winner's head has moved on only the matches on its leaf-to-root path are
+ * replayed: ceil(log2 k) calls of beats per element, about half of what a binary heap needs.
+ * beats(a, b) tells whether the head of source a goes out before the head of source b, and an
+ * exhausted source has to lose against every other one.
+ */
+template<typename Beats>
+class LoserTree {
+public:
+    LoserTree(size_t k, Beats beats) : k(k), leaves(1), beats(beats) {
+        while (leaves < k) leaves *= 2;
+        tree.resize(leaves);
+        tree[0] = build(1);
+    }
+
+    // EFFECTS: index of the source whose head goes out next, >= k when there are no sources
+    size_t winner() const { return tree[0]; }
+
+    // EFFECTS: replay the matches of the winner after its head changed
+    void replay() {
+        size_t w = tree[0];
+        for (size_t node = (leaves + w) / 2; node > 0; node /= 2) {
+            if (wins(tree[node], w)) std::swap(tree[node], w);
         }
-        mySwap(vector[i], vector[j]);
-        while (i < j && comp(vector[i], p)) {
-            i++;
+        tree[0] = w;
+    }
+
+private:
+    size_t k;
+    size_t leaves;
+    Beats beats;
+    std::vector<size_t> tree;
+
+    // the padding leaves past k lose against everything
+    bool wins(size_t a, size_t b) {
+        return a < k && (b >= k || beats(a, b));
+    }
+
+    size_t build(size_t node) {
+        if (node >= leaves) return node - leaves;
+        size_t a = build(2 * node), b = build(2 * node + 1);
+        if (wins(b, a)) std::swap(a, b);
+        tree[node] = b;
+        return a;
+    }
+};
+
+// EFFECTS: the match of LoserTree on the heads of sorted ranges: an exhausted range loses, and on
+//          equivalent heads the range with the smaller index wins, which keeps the merge stable
+template<typename RandomIt, typename Compare>
+struct range_beats {
+    std::vector<std::pair<RandomIt, RandomIt>> *runs;
+    Compare comp;
+
+    bool operator()(size_t a, size_t b) const {
+        const std::pair<RandomIt, RandomIt> &x = (*runs)[a], &y = (*runs)[b];
+        if (x.first == x.second) return false;
+        if (y.first == y.second) return true;
+        return a < b ? !comp(*y.first, *x.first) : comp(*x.first, *y.first);
+    }
+};
+
+// EFFECTS: stable k-way merge of the sorted ranges runs into out with a LoserTree, one pass and
+//          ceil(log2 k) comparisons per element; on equivalent elements earlier runs go first.
+//          Returns the end of the output
+template<typename RandomIt, typename OutputIt, typename Compare>
+OutputIt multiway_merge(std::vector<std::pair<RandomIt, RandomIt>> runs, OutputIt out, Compare comp) {
+    if (runs.empty()) return out;
+    if (runs.size() == 1) return std::copy(runs[0].first, runs[0].second, out);
+    LoserTree<range_beats<RandomIt, Compare>> tree(runs.size(), range_beats<RandomIt, Compare>{&runs, comp});
+    while (true) {
+        std::pair<RandomIt, RandomIt> &run = runs[tree.winner()];
+        if (run.first == run.second) return out;
+        *out = *run.first;
+        ++out;
+        ++run.first;
+        tree.replay();
+    }
+}
+
+// EFFECTS: split the stable merge of runs at output rank: position[i] is how many elements of
+//          runs[i] are among the first rank outputs. Every round takes the middle element x of the
+//          widest candidate range, counts the elements before x in every run by binary search and
+//          moves either the lower or the upper bounds to those counts, so it takes O(k log n) rounds
+template<typename RandomIt, typename Compare>
+void multiway_split(const std::vector<std::pair<RandomIt, RandomIt>> &runs, ptrdiff_t rank,
+                    std::vector<ptrdiff_t> &position, Compare comp) {
+    size_t k = runs.size();
+    position.assign(k, 0);
+    if (k == 0) return;
+    std::vector<ptrdiff_t> lo(k, 0), hi(k), before(k);
+    for (size_t i = 0; i < k; i++) hi[i] = runs[i].second - runs[i].first;
+    while (true) {
+        size_t widest = 0;
+        for (size_t i = 1; i < k; i++) {
+            if (hi[i] - lo[i] > hi[widest] - lo[widest]) widest = i;
+        }
+        if (hi[widest] == lo[widest]) break;
+        ptrdiff_t mid = lo[widest] + (hi[widest] - lo[widest]) / 2;
+        const auto &x = runs[widest].first[mid];
+        ptrdiff_t count = 0;
+        for (size_t i = 0; i < k; i++) {
+            RandomIt first = runs[i].first;
+            if (i == widest) before[i] = mid;
+            else if (i < widest) before[i] = std::upper_bound(first + lo[i], first + hi[i], x, comp) - first;
+            else before[i] = std::lower_bound(first + lo[i], first + hi[i], x, comp) - first;
+            count += before[i];
+        }
+        // the counts are clamped to [lo, hi], which does not change the bounds they lead to
+        if (count < rank) {
+            for (size_t i = 0; i < k; i++) lo[i] = before[i];
+            lo[widest] = mid + 1;
+        } else {
+            for (size_t i = 0; i < k; i++) hi[i] = before[i];
+        }
+    }
+    position = lo;
+}
+
+// EFFECTS: multiway_merge with the output cut into pieces of equal length at exact ranks by
+//          multiway_split, and every piece merged as its own task; the result is the same as
+//          the serial merge, and all the data is still read and written once
+template<typename RandomIt, typename RandomOut, typename Compare>
+RandomOut parallel_multiway_merge(const std::vector<std::pair<RandomIt, RandomIt>> &runs, RandomOut out,
+                                  Compare comp, WorkStealingPool &pool) {
+    ptrdiff_t total = 0;
+    for (const auto &run : runs) total += run.second - run.first;
+    ptrdiff_t pieces = std::min(total / PARALLEL_SORT_GRAIN, (ptrdiff_t) pool.size() * 4);
+    if (pieces < 2) return multiway_merge(runs, out, comp);
+    std::vector<std::vector<ptrdiff_t>> split(pieces + 1);
+    {
+        TaskGroup group(pool);
+        for (ptrdiff_t p = 0; p <= pieces; p++) {
+            group.run([&, p] { multiway_split(runs, total * p / pieces, split[p], comp); });
+        }
+        group.wait();
+    }
+    TaskGroup group(pool);
+    for (ptrdiff_t p = 0; p < pieces; p++) {
+        group.run([&, p] {
+            std::vector<std::pair<RandomIt, RandomIt>> slices;
+            slices.reserve(runs.size());
+            for (size_t i = 0; i < runs.size(); i++) {
+                slices.emplace_back(runs[i].first + split[p][i], runs[i].first + split[p + 1][i]);
+            }
+            multiway_merge(std::move(slices), out + total * p / pieces, comp);
+        });
+    }
+    group.wait();
+    return out + total;
+}
+
+template<typename RandomIt, typename RandomOut, typename Compare>
+RandomOut parallel_multiway_merge(const std::vector<std::pair<RandomIt, RandomIt>> &runs, RandomOut out,
+                                  Compare comp) {
+    return parallel_multiway_merge(runs, out, comp, WorkStealingPool::shared());
+}
+
+// length of the runs merge_sort_bottom_up starts from, sorted by insertion sort
+const size_t BOTTOM_UP_RUN = 32;
+
+// EFFECTS: bottom-up merge sort which alternates between vector and scratch as source and target of
+//          its passes, so no pass copies back; when the number of passes is odd the first runs are
+//          sorted into scratch, so the last pass still ends in vector. scratch must hold at least
+//          vector.size() elements (their values are overwritten), nothing is allocated; elements
+//          are only ever moved, so T may be move-only
+template<typename T, typename Compare>
+void merge_sort_bottom_up(std::vector<T> &vector, T *scratch, size_t scratchSize, Compare comp = std::less<T>()) {
+    size_t size = vector.size();
+    if (size < 2) return;
+    if (scratchSize < size) throw std::invalid_argument("merge_sort_bottom_up: scratch buffer too small");
+    int passes = 0;
+    for (size_t width = BOTTOM_UP_RUN; width < size; width *= 2) passes++;
+    T *source = vector.data();
+    T *target = scratch;
+    if (passes % 2 == 1) {
+        std::move(vector.begin(), vector.end(), scratch);
+        std::swap(source, target);
+    }
+    for (size_t lo = 0; lo < size; lo += BOTTOM_UP_RUN) {
+        size_t hi = std::min(lo + BOTTOM_UP_RUN, size);
+        if (!simd_network_stable_sort(source + lo, (int) (hi - lo), comp)) insertion_sort(source + lo, source + hi, comp);
+    }
+    for (size_t width = BOTTOM_UP_RUN; width < size; width *= 2) {
+        for (size_t lo = 0; lo < size; lo += 2 * width) {
+            size_t mid = std::min(lo + width, size);
+            size_t hi = std::min(lo + 2 * width, size);
+            merge_range(source + lo, source + mid, source + mid, source + hi, target + lo, comp);
         }
-        mySwap(vector[i], vector[j]);
+        std::swap(source, target);
     }
-    quick_sort_inplace_helper(vector, left, i - 1, comp);
-    quick_sort_inplace_helper(vector, i + 1, right, comp);
 }
 
+// EFFECTS: same as above with a caller-owned scratch vector, which is only reallocated when it is
+//          smaller than vector, so sorting in a loop with the same scratch allocates once
+template<typename T, typename Compare>
+void merge_sort_bottom_up(std::vector<T> &vector, std::vector<T> &scratch, Compare comp = std::less<T>()) {
+    if (scratch.size() < vector.size()) scratch = scratch_buffer(vector.begin(), vector.end());
+    merge_sort_bottom_up(vector, scratch.data(), scratch.size(), comp);
+}
 
+// EFFECTS: same as above with a scratch buffer of its own (see scratch_buffer), so T needs
+//          neither a default constructor nor a copy constructor
 template<typename T, typename Compare>
-void quick_sort_inplace(std::vector<T> &vector, Compare comp = std::less<T>()) {
-    // TODO: implement
-    quick_sort_inplace_helper(vector, 0, (int) vector.size() - 1, comp);
+void merge_sort_bottom_up(std::vector<T> &vector, Compare comp = std::less<T>()) {
+    if (vector.size() < 2) return;
+    std::vector<T> scratch = scratch_buffer(vector.begin(), vector.end());
+    merge_sort_bottom_up(vector, scratch.data(), scratch.size(), comp);
+}
+
+/**
+ * State of one tim_sort call: the stack of pending runs, the adaptive gallop threshold and
+ * the merge buffer (which only ever holds the shorter of two runs)
+ * Elements are only ever moved, so T may be move-only.
+ * Runs are maximal ascending or strictly descending stretches (the latter are reversed, which
+ * keeps the sort stable), extended to minRun elements by binary insertion sort. The stack keeps
+ * len[i - 2] > len[i - 1] + len[i] and len[i - 1] > len[i], so run lengths grow at least like
+ * Fibonacci numbers and merges stay balanced. A merge switches to galloping (exponential then
+ * binary search) once one run wins MIN_GALLOP times in a row.
+ * Time complexity: O(n) for sorted or reverse sorted input, O(n log n) in the worst case
+ */
+template<typename T, typename Compare>
+class TimSorter {
+public:
+    TimSorter(T *data, size_t size, Compare comp) : data(data), size(size), comp(comp) {}
+
+    void sort() {
+        if (size < 2) return;
+        size_t minRun = minRunLength(size);
+        size_t lo = 0;
+        while (lo < size) {
+            size_t run = countRun(lo);
+            if (run < minRun) {
+                size_t forced = std::min(minRun, size - lo);
+                binaryInsertionSort(lo, lo + forced, lo + run);
+                run = forced;
+            }
+            runBase.push_back(lo);
+            runLength.push_back(run);
+            mergeCollapse();
+            lo += run;
+        }
+        mergeForceCollapse();
+    }
+
+private:
+    static const int MIN_GALLOP = 7;
+
+    T *data;
+    size_t size;
+    Compare comp;
+    int minGallop = MIN_GALLOP;
+    std::vector<T> buffer;
+    std::vector<size_t> runBase;
+    std::vector<size_t> runLength;
+
+    // EFFECTS: a length in [32, 64] such that size / minRun is a power of two or slightly below
+    static size_t minRunLength(size_t n) {
+        size_t r = 0;
+        while (n >= 64) {
+            r |= n & 1;
+            n >>= 1;
+        }
+        return n + r;
+    }
+
+    // EFFECTS: length of the run starting at lo, a strictly descending run is reversed in place
+    size_t countRun(size_t lo) {
+        size_t hi = lo + 1;
+        if (hi == size) return 1;
+        if (comp(data[hi], data[lo])) {
+            while (hi < size && comp(data[hi], data[hi - 1])) hi++;
+            std::reverse(data + lo, data + hi);
+        } else {
+            while (hi < size && !comp(data[hi], data[hi - 1])) hi++;
+        }
+        return hi - lo;
+    }
+
+    // EFFECTS: sort data[lo, hi) whose prefix data[lo, start) is already sorted
+    void binaryInsertionSort(size_t lo, size_t hi, size_t start) {
+        for (; start < hi; start++) {
+            T pivot = std::move(data[start]);
+            T *position = std::upper_bound(data + lo, data + start, pivot, comp);
+            std::move_backward(position, data + start, data + start + 1);
+            *position = std::move(pivot);
+        }
+    }
+
+    // EFFECTS: position of the first element of a[0, n) which is not less than key,
+    //          searched exponentially from a[hint] first
+    ptrdiff_t gallopLeft(const T &key, const T *a, ptrdiff_t n, ptrdiff_t hint) {
+        ptrdiff_t lastOffset = 0, offset = 1;
+        if (comp(a[hint], key)) {
+            ptrdiff_t maxOffset = n - hint;
+            while (offset < maxOffset && comp(a[hint + offset], key)) {
+                lastOffset = offset;
+                offset = 2 * offset + 1;
+            }
+            if (offset > maxOffset) offset = maxOffset;
+            lastOffset += hint;
+            offset += hint;
+        } else {
+            ptrdiff_t maxOffset = hint + 1;
+            while (offset < maxOffset && !comp(a[hint - offset], key)) {
+                lastOffset = offset;
+                offset = 2 * offset + 1;
+            }
+            if (offset > maxOffset) offset = maxOffset;
+            ptrdiff_t temp = lastOffset;
+            lastOffset = hint - offset;
+            offset = hint - temp;
+        }
+        // a[lastOffset] < key <= a[offset]
+        lastOffset++;
+        while (lastOffset < offset) {
+            ptrdiff_t mid = lastOffset + (offset - lastOffset) / 2;
+            if (comp(a[mid], key)) lastOffset = mid + 1;
+            else offset = mid;
+        }
+        return offset;
+    }
+
+    // EFFECTS: position of the first element of a[0, n) which is greater than key,
+    //          searched exponentially from a[hint] first
+    ptrdiff_t gallopRight(const T &key, const T *a, ptrdiff_t n, ptrdiff_t hint) {
+        ptrdiff_t lastOffset = 0, offset = 1;
+        if (comp(key, a[hint])) {
+            ptrdiff_t maxOffset = hint + 1;
+            while (offset < maxOffset && comp(key, a[hint - offset])) {
+                lastOffset = offset;
+                offset = 2 * offset + 1;
+            }
+            if (offset > maxOffset) offset = maxOffset;
+            ptrdiff_t temp = lastOffset;
+            lastOffset = hint - offset;
+            offset = hint - temp;
+        } else {
+            ptrdiff_t maxOffset = n - hint;
+            while (offset < maxOffset && !comp(key, a[hint + offset])) {
+                lastOffset = offset;
+                offset = 2 * offset + 1;
+            }
+            if (offset > maxOffset) offset = maxOffset;
+            lastOffset += hint;
+            offset += hint;
+        }
+        // a[lastOffset] <= key < a[offset]
+        lastOffset++;
+        while (lastOffset < offset) {
+            ptrdiff_t mid = lastOffset + (offset - lastOffset) / 2;
+            if (comp(key, a[mid])) offset = mid;
+            else lastOffset = mid + 1;
+        }
+        return offset;
+    }
+
+    void mergeCollapse() {
+        while (runLength.size() > 1) {
+            size_t k = runLength.size() - 2;
+            if ((k > 0 && runLength[k - 1] <= runLength[k] + runLength[k + 1]) ||
+                (k > 1 && runLength[k - 2] <= runLength[k - 1] + runLength[k])) {
+                if (runLength[k - 1] < runLength[k + 1]) k--;
+                mergeAt(k);
+            } else if (runLength[k] <= runLength[k + 1]) {
+                mergeAt(k);
+            } else break;
+        }
+    }
+
+    void mergeForceCollapse() {
+        while (runLength.size() > 1) {
+            size_t k = runLength.size() - 2;
+            if (k > 0 && runLength[k - 1] < runLength[k + 1]) k--;
+            mergeAt(k);
+        }
+    }
+
+    // EFFECTS: merge the runs k and k + 1 of the stack, skipping the prefix of run k and the suffix of
+    //          run k + 1 which are already in place
+    void mergeAt(size_t k) {
+        size_t baseA = runBase[k], lengthA = runLength[k];
+        size_t baseB = runBase[k + 1], lengthB = runLength[k + 1];
+        runLength[k] = lengthA + lengthB;
+        runBase.erase(runBase.begin() + k + 1);
+        runLength.erase(runLength.begin() + k + 1);
+        size_t skip = gallopRight(data[baseB], data + baseA, lengthA, 0);
+        baseA += skip;
+        lengthA -= skip;
+        if (lengthA == 0) return;
+        lengthB = gallopLeft(data[baseA + lengthA - 1], data + baseB, lengthB, lengthB - 1);
+        if (lengthB == 0) return;
+        if (lengthA <= lengthB) mergeLow(baseA, lengthA, baseB, lengthB);
+        else mergeHigh(baseA, lengthA, baseB, lengthB);
+    }
+
+    // EFFECTS: merge from the front with run A (the shorter one) in the buffer
+    void mergeLow(size_t baseA, size_t lengthA, size_t baseB, size_t lengthB) {
+        buffer.assign(std::make_move_iterator(data + baseA), std::make_move_iterator(data + baseA + lengthA));
+        T *a = buffer.data(), *aEnd = a + lengthA;
+        T *b = data + baseB, *bEnd = b + lengthB;
+        T *dest = data + baseA;
+        while (a != aEnd && b != bEnd) {
+            int winsA = 0, winsB = 0;
+            while (a != aEnd && b != bEnd) {
+                if (comp(*b, *a)) {
+                    *dest++ = std::move(*b++);
+                    winsA = 0;
+                    if (++winsB >= minGallop) break;
+                } else {
+                    *dest++ = std::move(*a++);
+                    winsB = 0;
+                    if (++winsA >= minGallop) break;
+                }
+            }
+            while (a != aEnd && b != bEnd) {
+                winsA = (int) gallopRight(*b, a, aEnd - a, 0);
+                dest = std::move(a, a + winsA, dest);
+                a += winsA;
+                if (a == aEnd) break;
+                *dest++ = std::move(*b++);
+                if (b == bEnd) break;
+                winsB = (int) gallopLeft(*a, b, bEnd - b, 0);
+                dest = std::move(b, b + winsB, dest);
+                b += winsB;
+                if (b == bEnd) break;
+                *dest++ = std::move(*a++);
+                if (minGallop > 1) minGallop--;
+                if (winsA < MIN_GALLOP && winsB < MIN_GALLOP) {
+                    minGallop += 2;
+                    break;
+                }
+            }
+        }
+        std::move(a, aEnd, dest);
+    }
+
+    // EFFECTS: merge from the back with run B (the shorter one) in the buffer
+    void mergeHigh(size_t baseA, size_t lengthA, size_t baseB, size_t lengthB) {
+        buffer.assign(std::make_move_iterator(data + baseB), std::make_move_iterator(data + baseB + lengthB));
+        T *aBegin = data + baseA, *a = aBegin + lengthA;
+        T *bBegin = buffer.data(), *b = bBegin + lengthB;
+        T *dest = data + baseB + lengthB;
+        while (a != aBegin && b != bBegin) {
+            int winsA = 0, winsB = 0;
+            while (a != aBegin && b != bBegin) {
+                if (comp(*(b - 1), *(a - 1))) {
+                    *--dest = std::move(*--a);
+                    winsB = 0;
+                    if (++winsA >= minGallop) break;
+                } else {
+                    *--dest = std::move(*--b);
+                    winsA = 0;
+                    if (++winsB >= minGallop) break;
+                }
+            }
+            while (a != aBegin && b != bBegin) {
+                winsA = (int) ((a - aBegin) - gallopRight(*(b - 1), aBegin, a - aBegin, a - aBegin - 1));
+                dest = std::move_backward(a - winsA, a, dest);
+                a -= winsA;
+                if (a == aBegin) break;
+                *--dest = std::move(*--b);
+                if (b == bBegin) break;
+                winsB = (int) ((b - bBegin) - gallopLeft(*(a - 1), bBegin, b - bBegin, b - bBegin - 1));
+                dest = std::move_backward(b - winsB, b, dest);
+                b -= winsB;
+                if (b == bBegin) break;
+                *--dest = std::move(*--a);
+                if (minGallop > 1) minGallop--;
+                if (winsA < MIN_GALLOP && winsB < MIN_GALLOP) {
+                    minGallop += 2;
+                    break;
+                }
+            }
+        }
+        std::move_backward(bBegin, b, dest);
+    }
+};
+
+// EFFECTS: stable natural merge sort (Timsort), linear on sorted / reverse sorted input and
+//          fast on input made of a few sorted stretches, see TimSorter
+template<typename T, typename Compare>
+void tim_sort(std::vector<T> &vector, Compare comp = std::less<T>()) {
+    TimSorter<T, Compare>(vector.data(), vector.size(), comp).sort();
+}
+
+// EFFECTS: maps a key onto an unsigned integer with the same order, so that keys can be
+//          sorted digit by digit (signed: flip the sign bit; floating point: flip all
+//          bits of negatives and the sign bit of positives, NaNs at the ends; -0.0 is encoded
+//          as +0.0, since the two compare equal and a stable sort must keep their order)
+template<typename Key, bool Integral = std::is_integral<Key>::value>
+struct radix_key_traits {
+    typedef typename std::make_unsigned<Key>::type Bits;
+
+    static Bits encode(Key key) {
+        Bits bits = static_cast<Bits>(key);
+        if (std::is_signed<Key>::value) bits ^= Bits(1) << (sizeof(Bits) * 8 - 1);
+        return bits;
+    }
+};
+
+template<typename Key>
+struct radix_key_traits<Key, false> {
+    static_assert(std::is_floating_point<Key>::value && (sizeof(Key) == 4 || sizeof(Key) == 8),
+                  "radix_sort needs an integral, float or double key");
+    typedef typename std::conditional<sizeof(Key) == 4, uint32_t, uint64_t>::type Bits;
+
+    static Bits encode(Key key) {
+        if (key == 0) key = 0;
+        Bits bits;
+        std::memcpy(&bits, &key, sizeof(bits));
+        const Bits sign = Bits(1) << (sizeof(Bits) * 8 - 1);
+        return (bits & sign) ? ~bits : bits | sign;
+    }
+};
+
+template<typename T>
+struct identity_key {
+    const T &operator()(const T &value) const { return value; }
+};
+
+// EFFECTS: the digit counts of radix_sort, all histograms in one pass over the encoded keys
+template<typename Bits, typename BitsOf>
+std::vector<size_t> radix_histograms(size_t size, BitsOf bitsOf) {
+    const int DIGITS = sizeof(Bits);
+    std::vector<size_t> count(DIGITS * 256, 0);
+    for (size_t i = 0; i < size; i++) {
+        Bits bits = bitsOf(i);
+        for (int d = 0; d < DIGITS; d++) {
+            count[d * 256 + ((bits >> (d * 8)) & 0xff)]++;
+        }
+    }
+    return count;
+}
+
+// EFFECTS: turn the counts of one digit into bucket offsets, false if all keys share the digit
+inline bool radix_offsets(size_t *bucket, size_t size, int digit) {
+    if (bucket[digit] == size) return false;
+    size_t sum = 0;
+    for (int b = 0; b < 256; b++) {
+        size_t c = bucket[b];
+        bucket[b] = sum;
+        sum += c;
+    }
+    return true;
+}
+
+// EFFECTS: radix_sort which projects and encodes the key again in every pass, for keys that are
+//          the element itself or a field of it, where storing the encoded keys would cost more (a
+//          second scattered stream per pass) than reading them again
+template<typename T, typename KeyOf>
+void radix_sort(std::vector<T> &vector, KeyOf key, std::true_type) {
+    typedef typename std::decay<decltype(key(vector[0]))>::type Key;
+    typedef radix_key_traits<Key> Traits;
+    typedef typename Traits::Bits Bits;
+    size_t size = vector.size();
+    std::vector<size_t> count = radix_histograms<Bits>(size, [&](size_t i) { return Traits::encode(key(vector[i])); });
+    std::vector<T> scratch = scratch_buffer(vector.begin(), vector.end());
+    T *source = vector.data();
+    T *target = scratch.data();
+    for (int d = 0; d < (int) sizeof(Bits); d++) {
+        size_t *bucket = &count[d * 256];
+        if (!radix_offsets(bucket, size, (int) ((Traits::encode(key(source[0])) >> (d * 8)) & 0xff))) continue;
+        for (size_t i = 0; i < size; i++) {
+            Bits bits = Traits::encode(key(source[i]));
+            target[bucket[(bits >> (d * 8)) & 0xff]++] = std::move(source[i]);
+        }
+        std::swap(source, target);
+    }
+    if (source != vector.data()) std::move(source, source + size, vector.data());
+}
+
+// EFFECTS: radix_sort through a projected key: every key is projected and encoded once, and the
+//          encoded keys are scattered along with the elements
+template<typename T, typename KeyOf>
+void radix_sort(std::vector<T> &vector, KeyOf key, std::false_type) {
+    typedef typename std::decay<decltype(key(vector[0]))>::type Key;
+    typedef radix_key_traits<Key> Traits;
+    typedef typename Traits::Bits Bits;
+    size_t size = vector.size();
+    std::vector<Bits> keys(size), scratchKeys(size);
+    for (size_t i = 0; i < size; i++) keys[i] = Traits::encode(key(vector[i]));
+    std::vector<size_t> count = radix_histograms<Bits>(size, [&](size_t i) { return keys[i]; });
+    std::vector<T> scratch = scratch_buffer(vector.begin(), vector.end());
+    T *source = vector.data();
+    T *target = scratch.data();
+    Bits *sourceKeys = keys.data();
+    Bits *targetKeys = scratchKeys.data();
+    for (int d = 0; d < (int) sizeof(Bits); d++) {
+        size_t *bucket = &count[d * 256];
+        if (!radix_offsets(bucket, size, (int) ((sourceKeys[0] >> (d * 8)) & 0xff))) continue;
+        for (size_t i = 0; i < size; i++) {
+            size_t to = bucket[(sourceKeys[i] >> (d * 8)) & 0xff]++;
+            target[to] = std::move(source[i]);
+            targetKeys[to] = sourceKeys[i];
+        }
+        std::swap(source, target);
+        std::swap(sourceKeys, targetKeys);
+    }
+    if (source != vector.data()) std::move(source, source + size, vector.data());
+}
+
+// EFFECTS: stable LSD radix sort on 8-bit digits of key(element)
+//          all digit histograms are taken in one pass, and a digit which is the same
+//          for every element is skipped without touching the data. A key returned by value is
+//          taken to be computed and is called once per element; a key returned by reference is
+//          taken to be a field of the element and is read again in every pass
+template<typename T, typename KeyOf>
+void radix_sort(std::vector<T> &vector, KeyOf key) {
+    if (vector.size() < 2) return;
+    radix_sort(vector, key, std::is_reference<decltype(key(vector[0]))>());
+}
+
+template<typename T>
+void radix_sort(std::vector<T> &vector) {
+    radix_sort(vector, identity_key<T>());
+}
+
+// EFFECTS: whether radix_key_traits can encode Key
+template<typename Key>
+struct radix_sortable_key : std::integral_constant<bool,
+        (std::is_integral<Key>::value && !std::is_same<Key, bool>::value) ||
+        (std::is_floating_point<Key>::value && (sizeof(Key) == 4 || sizeof(Key) == 8))> {
+};
+
+// EFFECTS: uniform component access for the MSD radix sort, a plain key is a 1-tuple
+template<typename Key>
+struct radix_tuple {
+    static const size_t size = 1;
+    static const bool sortable = radix_sortable_key<Key>::value;
+
+    template<size_t C>
+    static const Key &get(const Key &key) { return key; }
+};
+
+template<typename... Keys>
+struct radix_tuple<std::tuple<Keys...>> {
+    static const size_t size = sizeof...(Keys);
+    static const bool sortable = size > 0 && std::is_same<
+            std::integer_sequence<bool, true, radix_sortable_key<typename std::decay<Keys>::type>::value...>,
+            std::integer_sequence<bool, radix_sortable_key<typename std::decay<Keys>::type>::value..., true>>::value;
+
+    template<size_t C>
+    static const typename std::tuple_element<C, std::tuple<Keys...>>::type &get(const std::tuple<Keys...> &key) {
+        return std::get<C>(key);
+    }
+};
+
+// below this many elements a bucket of msd_radix_sort is finished with insertion_sort
+const int MSD_RADIX_INSERTION_THRESHOLD = 32;
+
+// EFFECTS: lexicographic order of the encoded key components, i.e. the order msd_radix_sort produces
+template<typename KeyOf>
+struct msd_radix_less {
+    KeyOf key;
+
+    template<typename T>
+    bool operator()(const T &a, const T &b) const {
+        return less<0>(key(a), key(b), std::true_type());
+    }
+
+    template<size_t C, typename Key>
+    static bool less(const Key &, const Key &, std::false_type) {
+        return false;
+    }
+
+    template<size_t C, typename Key>
+    static bool less(const Key &a, const Key &b, std::true_type) {
+        typedef typename std::decay<decltype(radix_tuple<Key>::template get<C>(a))>::type Component;
+        auto x = radix_key_traits<Component>::encode(radix_tuple<Key>::template get<C>(a));
+        auto y = radix_key_traits<Component>::encode(radix_tuple<Key>::template get<C>(b));
+        if (x != y) return x < y;
+        return less<C + 1>(a, b, std::integral_constant<bool, (C + 1 < radix_tuple<Key>::size)>());
+    }
+};
+
+template<size_t C, typename T, typename KeyOf>
+void msd_radix_sort_helper(std::vector<T> &, int, int, int, KeyOf, std::false_type) {
+}
+
+// EFFECTS: American flag sort of vector[left..right] on byte `digit` (counted from the most
+//          significant one) of component C, then recurse into every bucket on the next byte
+template<size_t C, typename T, typename KeyOf>
+void msd_radix_sort_helper(std::vector<T> &vector, int left, int right, int digit, KeyOf key, std::true_type) {
+    typedef typename std::decay<decltype(key(vector[0]))>::type Key;
+    typedef typename std::decay<decltype(radix_tuple<Key>::template get<C>(key(vector[0])))>::type Component;
+    typedef radix_key_traits<Component> Traits;
+    const int DIGITS = sizeof(typename Traits::Bits);
+    if (right - left + 1 <= MSD_RADIX_INSERTION_THRESHOLD) {
+        insertion_sort(vector, left, right, msd_radix_less<KeyOf>{key});
+        return;
+    }
+    const int shift = (DIGITS - 1 - digit) * 8;
+    auto byteOf = [&](const T &value) {
+        return (int) ((Traits::encode(radix_tuple<Key>::template get<C>(key(value))) >> shift) & 0xff);
+    };
+    int count[256] = {0};
+    for (int i = left; i <= right; i++) count[byteOf(vector[i])]++;
+    int begin[257];
+    int next[256];
+    begin[0] = left;
+    for (int b = 0; b < 256; b++) {
+        begin[b + 1] = begin[b] + count[b];
+        next[b] = begin[b];
+    }
+    if (count[byteOf(vector[left])] != right - left + 1) {
+        for (int b = 0; b < 256; b++) {
+            while (next[b] < begin[b + 1]) {
+                int target = byteOf(vector[next[b]]);
+                if (target == b) next[b]++;
+                else mySwap(vector[next[b]], vector[next[target]++]);
+            }
+        }
+    }
+    for (int b = 0; b < 256; b++) {
+        if (count[b] < 2) continue;
+        if (digit + 1 < DIGITS) {
+            msd_radix_sort_helper<C>(vector, begin[b], begin[b + 1] - 1, digit + 1, key, std::true_type());
+        } else {
+            msd_radix_sort_helper<C + 1>(vector, begin[b], begin[b + 1] - 1, 0, key,
+                                         std::integral_constant<bool, (C + 1 < radix_tuple<Key>::size)>());
+        }
+    }
+}
+
+// EFFECTS: in-place (unstable) MSD radix sort on key(element), which is either an integral /
+//          floating point key or a std::tuple of them compared lexicographically;
+//          needs no scratch buffer, the recursion depth is bounded by the key width in bytes
+template<typename T, typename KeyOf>
+void msd_radix_sort(std::vector<T> &vector, KeyOf key) {
+    typedef typename std::decay<decltype(key(std::declval<T>()))>::type Key;
+    static_assert(radix_tuple<Key>::sortable, "msd_radix_sort needs integral / floating point key components");
+    if (vector.size() < 2) return;
+    msd_radix_sort_helper<0>(vector, 0, (int) vector.size() - 1, 0, key, std::true_type());
+}
+
+template<typename T>
+void msd_radix_sort(std::vector<T> &vector) {
+    msd_radix_sort(vector, identity_key<T>());
+}
+
+// below this many strings multikey_quick_sort finishes with insertion sort on the suffixes
+const int MULTIKEY_INSERTION_THRESHOLD = 16;
+// characters of a string packed into one cached key of multikey_quick_sort
+const size_t MULTIKEY_CHARS = 7;
+
+// EFFECTS: the MULTIKEY_CHARS characters of s from depth on, big endian, followed by a byte with
+//          the number of them that exist, so that the keys of two strings compare like their
+//          suffixes and a key with a count below MULTIKEY_CHARS marks the end of the string
+inline uint64_t multikey_chars(const std::string *s, size_t depth) {
+    uint64_t key = 0;
+    size_t size = s->size();
+    for (size_t i = 0; i < MULTIKEY_CHARS; i++) {
+        key = (key << 8) | (depth + i < size ? (unsigned char) (*s)[depth + i] : 0);
+    }
+    return (key << 8) | (size > depth ? std::min(size - depth, MULTIKEY_CHARS) : 0);
+}
+
+// EFFECTS: length of the common prefix of a and b, both known to share the first depth characters
+inline size_t multikey_lcp(const std::string *a, const std::string *b, size_t depth) {
+    size_t limit = std::min(a->size(), b->size());
+    while (depth < limit && (*a)[depth] == (*b)[depth]) depth++;
+    return depth;
+}
+
+// EFFECTS: sort strings[left..right], which share their first depth characters;
+//          cache[i] holds multikey_chars of strings[i] at depth when cached is set,
+//          and lcp[i] (if given) is filled with the common prefix of strings[i - 1] and strings[i]
+inline void multikey_quick_sort_helper(std::vector<std::string *> &strings, std::vector<uint64_t> &cache,
+                                       int left, int right, size_t depth, bool cached, size_t *lcp) {
+    while (right - left + 1 >= MULTIKEY_INSERTION_THRESHOLD) {
+        if (!cached) {
+            for (int i = left; i <= right; i++) cache[i] = multikey_chars(strings[i], depth);
+        }
+        uint64_t a = cache[left], b = cache[(left + right) / 2], c = cache[right];
+        uint64_t pivot = a < b ? (b < c ? b : (a < c ? c : a)) : (a < c ? a : (b < c ? c : b));
+        // three way partition: [left, lt) < pivot, [lt, gt] == pivot, (gt, right] > pivot
+        int lt = left, gt = right, i = left;
+        while (i <= gt) {
+            if (cache[i] < pivot) {
+                std::swap(strings[i], strings[lt]);
+                std::swap(cache[i++], cache[lt++]);
+            } else if (cache[i] > pivot) {
+                std::swap(strings[i], strings[gt]);
+                std::swap(cache[i], cache[gt--]);
+            } else i++;
+        }
+        multikey_quick_sort_helper(strings, cache, left, lt - 1, depth, true, lcp);
+        multikey_quick_sort_helper(strings, cache, gt + 1, right, depth, true, lcp);
+        if (lcp) {
+            if (lt > left) lcp[lt] = multikey_lcp(strings[lt - 1], strings[lt], depth);
+            if (gt < right) lcp[gt + 1] = multikey_lcp(strings[gt], strings[gt + 1], depth);
+        }
+        if ((pivot & 0xff) < MULTIKEY_CHARS) {
+            // every string of the middle group ends within these characters, so they are all equal
+            if (lcp) {
+                for (int k = lt + 1; k <= gt; k++) lcp[k] = strings[k]->size();
+            }
+            return;
+        }
+        left = lt;
+        right = gt;
+        depth += MULTIKEY_CHARS;
+        cached = false;
+    }
+    for (int i = left + 1; i <= right; i++) {
+        std::string *temp = strings[i];
+        int index = i - 1;
+        while (index >= left && temp->compare(depth, std::string::npos,
+                                              *strings[index], depth, std::string::npos) < 0) {
+            strings[index + 1] = strings[index];
+            index--;
+        }
+        strings[index + 1] = temp;
+    }
+    if (lcp) {
+        for (int i = left + 1; i <= right; i++) lcp[i] = multikey_lcp(strings[i - 1], strings[i], depth);
+    }
+}
+
+// EFFECTS: multikey quick sort of strings, i.e. a three way radix quick sort on a few character
+//          positions at a time, every character is read once and cached as part of an integer key;
+//          the strings are permuted through pointers and moved once at the end
+inline void multikey_quick_sort(std::vector<std::string> &vector, size_t *lcp) {
+    int size = (int) vector.size();
+    if (size == 0) return;
+    std::vector<std::string *> strings(size);
+    for (int i = 0; i < size; i++) strings[i] = &vector[i];
+    std::vector<uint64_t> cache(size);
+    if (lcp) lcp[0] = 0;
+    multikey_quick_sort_helper(strings, cache, 0, size - 1, 0, false, lcp);
+    std::vector<std::string> result;
+    result.reserve(size);
+    for (int i = 0; i < size; i++) result.push_back(std::move(*strings[i]));
+    vector.swap(result);
+}
+
+inline void multikey_quick_sort(std::vector<std::string> &vector) {
+    multikey_quick_sort(vector, nullptr);
+}
+
+// EFFECTS: also return the LCP array, lcp[i] is the common prefix length of vector[i - 1] and vector[i]
+inline void multikey_quick_sort(std::vector<std::string> &vector, std::vector<size_t> &lcp) {
+    lcp.assign(vector.size(), 0);
+    multikey_quick_sort(vector, lcp.data());
+}
+
+
+// EFFECTS: sift first[root] down in the max-heap first[0..size - 1]
+template<typename RandomIt, typename Compare, typename Policy>
+void sift_down(RandomIt first, ptrdiff_t size, ptrdiff_t root, Compare comp, Policy policy) {
+    while (true) {
+        ptrdiff_t child = 2 * root + 1;
+        if (child >= size) return;
+        if (child + 1 < size && comp(first[child], first[child + 1])) child++;
+        if (!comp(first[root], first[child])) return;
+        policy_swap(first[root], first[child], policy);
+        root = child;
+    }
+}
+
+template<typename RandomIt, typename Compare>
+void sift_down(RandomIt first, ptrdiff_t size, ptrdiff_t root, Compare comp) {
+    NoSortMetrics none;
+    sift_down(first, size, root, comp, none);
+}
+
+template<typename RandomIt, typename Compare, typename Policy>
+void heap_sort_helper(RandomIt first, RandomIt last, Compare comp, Policy policy) {
+    ptrdiff_t size = last - first;
+    for (ptrdiff_t i = size / 2 - 1; i >= 0; i--) sift_down(first, size, i, comp, policy);
+    for (ptrdiff_t end = size - 1; end > 0; end--) {
+        policy_swap(first[0], first[end], policy);
+        sift_down(first, end, 0, comp, policy);
+    }
+}
+
+template<typename RandomIt, typename Compare = std::less<typename std::iterator_traits<RandomIt>::value_type>>
+void heap_sort(RandomIt first, RandomIt last, Compare comp = Compare()) {
+    NoSortMetrics none;
+    heap_sort_helper(first, last, comp, none);
+}
+
+template<typename T, typename Compare>
+void heap_sort(std::vector<T> &vector, int left, int right, Compare comp = std::less<T>()) {
+    if (left < right) heap_sort(vector.begin() + left, vector.begin() + right + 1, comp);
+}
+
+template<typename T, typename Compare>
+void heap_sort(std::vector<T> &vector, Compare comp = std::less<T>()) {
+    heap_sort(vector.begin(), vector.end(), comp);
+}
+
+// below this many elements quick_sort_extra finishes with insertion sort
+const int QUICK_SORT_EXTRA_INSERTION_THRESHOLD = 24;
+// above this many elements the pivot of quick_sort_extra is the ninther (median of three medians of three)
+const int QUICK_SORT_EXTRA_NINTHER_THRESHOLD = 128;
+// from this many elements on quick_sort_extra partitions in parallel and recurses on both sides at once
+const int PARALLEL_PARTITION_THRESHOLD = 1 << 16;
+
+// EFFECTS: whether a and b are equivalent under comp
+template<typename T, typename Compare>
+bool equivalent(const T &a, const T &b, Compare comp) {
+    return !comp(a, b) && !comp(b, a);
+}
+
+// EFFECTS: index of the median of source[a], source[b] and source[c]
+template<typename T, typename Compare>
+ptrdiff_t median_of_three(const T *source, ptrdiff_t a, ptrdiff_t b, ptrdiff_t c, Compare comp) {
+    if (comp(source[a], source[b])) {
+        if (comp(source[b], source[c])) return b;
+        return comp(source[a], source[c]) ? c : a;
+    }
+    if (comp(source[a], source[c])) return a;
+    return comp(source[b], source[c]) ? c : b;
+}
+
+// EFFECTS: index of the pivot of source[left..right], the median of three or for larger ranges the
+//          ninther of the same samples as in quick_sort_inplace_helper (three neighbours each of the
+//          first, middle and last element), so that the samples never share one phase of a
+//          sawtooth or one slope of an organ pipe; no element is moved
+template<typename T, typename Compare>
+ptrdiff_t choose_pivot(const T *source, ptrdiff_t left, ptrdiff_t right, Compare comp) {
+    ptrdiff_t mid = left + (right - left + 1) / 2;
+    if (right - left + 1 <= QUICK_SORT_EXTRA_NINTHER_THRESHOLD) return median_of_three(source, left, mid, right, comp);
+    ptrdiff_t a = median_of_three(source, left, mid, right, comp);
+    ptrdiff_t b = median_of_three(source, left + 1, mid - 1, right - 1, comp);
+    ptrdiff_t c = median_of_three(source, left + 2, mid + 1, right - 2, comp);
+    return median_of_three(source, a, b, c, comp);
+}
+
+// EFFECTS: swap the elements choose_pivot samples with pseudo-random elements of data[left..right]
+//          to break up a pattern which produced a bad pivot; the swaps of quick_sort_inplace_helper
+//          go a quarter of the range away, which on a sawtooth whose period divides that distance
+//          swaps equal keys, so the partners are drawn by an xorshift seeded with the size
+template<typename T, typename Policy>
+void break_patterns(T *data, ptrdiff_t left, ptrdiff_t right, Policy policy) {
+    ptrdiff_t size = right - left + 1;
+    if (size < QUICK_SORT_EXTRA_INSERTION_THRESHOLD) return;
+    ptrdiff_t mid = left + size / 2;
+    ptrdiff_t samples[9] = {left, left + 1, left + 2, mid - 1, mid, mid + 1, right - 2, right - 1, right};
+    uint64_t random = (uint64_t) size;
+    for (ptrdiff_t sample : samples) {
+        random ^= random << 13;
+        random ^= random >> 7;
+        random ^= random << 17;
+        policy_swap(data[sample], data[left + (ptrdiff_t) (random % (uint64_t) size)], policy);
+    }
+}
+
+// EFFECTS: whether the pivot looks like a frequent key: it is equivalent to one of five samples other than itself
+template<typename T, typename Compare>
+bool frequent_pivot(const T *source, ptrdiff_t left, ptrdiff_t right, ptrdiff_t pivot, Compare comp) {
+    ptrdiff_t size = right - left + 1;
+    ptrdiff_t samples[5] = {left, left + size / 4, left + size / 2, right - size / 4, right};
+    for (ptrdiff_t sample : samples) {
+        if (sample != pivot && equivalent(source[sample], source[pivot], comp)) return true;
+    }
+    return false;
+}
+
+// EFFECTS: sort source[left..right] in place and make sure the result ends up in output
+template<typename T, typename Compare, typename Policy>
+void quick_sort_extra_leaf(T *output, T *source, ptrdiff_t left, ptrdiff_t right, Compare comp, Policy policy) {
+    SortPhaseScope<Policy> phase(policy, SortPhase::Leaf);
+    if (!simd_network_sort(source + left, (int) (right - left + 1), comp)) {
+        insertion_sort_helper(source + left, source + right + 1, comp, policy);
+    }
+    if (source != output) {
+        std::move(source + left, source + right + 1, output + left);
+        policy.move((size_t) (right - left + 1));
+    }
+}
+
+// EFFECTS: parallel three way partition of source[left + 1..right] around the pivot source[left] into
+//          target: blocks of the range count their smaller / equivalent / greater elements, prefix sums
+//          over the blocks give every block its own output slices, then all blocks scatter at once.
+//          The pivot and its equivalents are final and are moved on to output; returns their range [lt, gt]
+template<typename T, typename Compare>
+void partitionE_parallel(T *output, T *source, T *target, ptrdiff_t left, ptrdiff_t right,
+                         ptrdiff_t &lt, ptrdiff_t &gt, Compare comp, WorkStealingPool &pool) {
+    const T &p = source[left];
+    ptrdiff_t blocks = std::min((right - left) / PARALLEL_SORT_GRAIN, (ptrdiff_t) pool.size() * 4);
+    if (blocks < 1) blocks = 1;
+    std::vector<ptrdiff_t> count(3 * blocks, 0);
+    auto blockBegin = [=](ptrdiff_t block) { return left + 1 + (right - left) * block / blocks; };
+    auto classOf = [&](const T &value) { return comp(value, p) ? 0 : (comp(p, value) ? 2 : 1); };
+    {
+        TaskGroup group(pool);
+        for (ptrdiff_t block = 0; block < blocks; block++) {
+            group.run([&, block] {
+                ptrdiff_t *histogram = &count[3 * block];
+                for (ptrdiff_t i = blockBegin(block); i < blockBegin(block + 1); i++) histogram[classOf(source[i])]++;
+            });
+        }
+        group.wait();
+    }
+    ptrdiff_t offset = left;
+    for (int c = 0; c < 3; c++) {
+        if (c == 1) lt = offset++;
+        if (c == 2) gt = offset - 1;
+        for (ptrdiff_t block = 0; block < blocks; block++) {
+            ptrdiff_t n = count[3 * block + c];
+            count[3 * block + c] = offset;
+            offset += n;
+        }
+    }
+    TaskGroup group(pool);
+    for (ptrdiff_t block = 0; block < blocks; block++) {
+        group.run([&, block] {
+            ptrdiff_t *next = &count[3 * block];
+            for (ptrdiff_t i = blockBegin(block); i < blockBegin(block + 1); i++) {
+                int c = classOf(source[i]);
+                target[next[c]++] = std::move(source[i]);
+            }
+        });
+    }
+    group.wait();
+    target[lt] = std::move(source[left]);
+    if (target != output) std::move(target + lt, target + gt + 1, output + lt);
+}
+
+// EFFECTS: out-of-place quick sort of source[left..right] where target is the other one of output and
+//          the scratch buffer: every level partitions from source into target and the next level
+//          partitions back, so one buffer allocated up front serves all levels. Elements equivalent
+//          to a pivot are final and written to output, leaves are sorted in place and copied to
+//          output if they are in the scratch buffer. The smaller side is sorted by a recursive call
+//          and the larger one by the loop, so the stack stays O(log n); large ranges are partitioned
+//          in parallel and sort their two sides as separate tasks. After badAllowed partitions which
+//          leave more than 7/8 on one side (each one followed by break_patterns on both sides) the
+//          range is finished with heap sort, so the worst case is O(n log n)
+template<typename T, typename Compare, typename Policy>
+void quick_sort_extra_helper(T *output, T *source, T *target, ptrdiff_t left, ptrdiff_t right, int badAllowed,
+                             Compare comp, WorkStealingPool *pool, Policy policy) {
+    SortRecursion<Policy> recursion(policy);
+    while (true) {
+        ptrdiff_t size = right - left + 1;
+        if (size < 2) {
+            if (size == 1 && source != output) {
+                output[left] = std::move(source[left]);
+                policy.move(1);
+            }
+            return;
+        }
+        if (size < QUICK_SORT_EXTRA_INSERTION_THRESHOLD ||
+            (size <= SIMD_NETWORK_MAX && simd_network_sortable<T, Compare>::value)) {
+            quick_sort_extra_leaf(output, source, left, right, comp, policy);
+            return;
+        }
+        if (badAllowed == 0) {
+            heap_sort_helper(source + left, source + right + 1, comp, policy);
+            if (source != output) {
+                std::move(source + left, source + right + 1, output + left);
+                policy.move((size_t) size);
+            }
+            return;
+        }
+        policy.phase_begin(SortPhase::Partition);
+        ptrdiff_t pivot = choose_pivot(source, left, right, comp);
+        ptrdiff_t lt = left, gt = right;
+        bool frequent = frequent_pivot(source, left, right, pivot, comp);
+        if (left != pivot) policy_swap(source[left], source[pivot], policy);
+        if (pool && size >= PARALLEL_PARTITION_THRESHOLD) {
+            partitionE_parallel(output, source, target, left, right, lt, gt, comp, *pool);
+        } else if (frequent) {
+            // keys equivalent to the pivot are final and drop out of the recursion; they are
+            // compacted behind the pivot at the front of source while it is read and moved to
+            // output afterwards
+            const T &p = source[left];
+            ptrdiff_t l = left, r = right, e = left + 1;
+            for (ptrdiff_t i = left + 1; i <= right; i++) {
+                if (comp(source[i], p)) target[l++] = std::move(source[i]);
+                else if (comp(p, source[i])) target[r--] = std::move(source[i]);
+                else if (e++ != i) {
+                    source[e - 1] = std::move(source[i]);
+                    policy.move(1);
+                }
+            }
+            policy.move((size_t) (l - left + right - r));
+            if (output + l != source + left) {
+                std::move_backward(source + left, source + e, output + l + (e - left));
+                policy.move((size_t) (e - left));
+            }
+            lt = l;
+            gt = r;
+        } else {
+            ptrdiff_t l = left, r = right;
+            for (ptrdiff_t i = left + 1; i <= right; i++) {
+                if (comp(source[i], source[left])) target[l++] = std::move(source[i]);
+                else target[r--] = std::move(source[i]);
+            }
+            policy.move((size_t) (right - left));
+            if (output + l != source + left) {
+                output[l] = std::move(source[left]);
+                policy.move(1);
+            }
+            lt = gt = l;
+        }
+        ptrdiff_t leftSize = lt - left;
+        ptrdiff_t rightSize = right - gt;
+        if (leftSize > size - size / 8 || rightSize > size - size / 8) {
+            badAllowed--;
+            break_patterns(target, left, lt - 1, policy);
+            break_patterns(target, gt + 1, right, policy);
+        }
+        policy.phase_end(SortPhase::Partition);
+        policy.partition((size_t) leftSize, (size_t) rightSize);
+        if (pool && size >= PARALLEL_PARTITION_THRESHOLD) {
+            TaskGroup group(*pool);
+            group.run([&] { quick_sort_extra_helper(output, target, source, left, lt - 1, badAllowed, comp, pool, policy); });
+            quick_sort_extra_helper(output, target, source, gt + 1, right, badAllowed, comp, pool, policy);
+            group.wait();
+            return;
+        }
+        if (leftSize < rightSize) {
+            quick_sort_extra_helper(output, target, source, left, lt - 1, badAllowed, comp, pool, policy);
+            left = gt + 1;
+        } else {
+            quick_sort_extra_helper(output, target, source, gt + 1, right, badAllowed, comp, pool, policy);
+            right = lt - 1;
+        }
+        std::swap(source, target);
+    }
+}
+
+// EFFECTS: sort data[0..size - 1] with a scratch copy of it, see quick_sort_extra_helper
+template<typename T, typename Compare, typename Policy>
+void quick_sort_extra_contiguous(T *data, ptrdiff_t size, Compare comp, WorkStealingPool *pool, Policy policy) {
+    policy.phase_begin(SortPhase::Scratch);
+    auto scratch = scratch_buffer(data, data + size);
+    policy.phase_end(SortPhase::Scratch);
+    int badAllowed = 1;
+    for (ptrdiff_t n = size; n > 1; n >>= 1) badAllowed++;
+    quick_sort_extra_helper(data, data, scratch.data(), 0, size - 1, badAllowed, comp, pool, policy);
+}
+
+template<typename RandomIt, typename Compare, typename Policy>
+void quick_sort_extra(RandomIt first, RandomIt last, Compare comp, WorkStealingPool *pool, Policy policy,
+                      std::true_type) {
+    quick_sort_extra_contiguous(unwrap_iterator(first), last - first, comp, pool, policy);
+}
+
+// EFFECTS: the partitions ping-pong between two arrays anyway, so other storage is gathered into
+//          one, sorted there and copied back
+template<typename RandomIt, typename Compare, typename Policy>
+void quick_sort_extra(RandomIt first, RandomIt last, Compare comp, WorkStealingPool *pool, Policy policy,
+                      std::false_type) {
+    typedef typename std::iterator_traits<RandomIt>::value_type T;
+    policy.phase_begin(SortPhase::Scratch);
+    std::vector<T> data(std::make_move_iterator(first), std::make_move_iterator(last));
+    policy.phase_end(SortPhase::Scratch);
+    quick_sort_extra_contiguous(data.data(), last - first, comp, pool, policy);
+    std::move(data.begin(), data.end(), first);
+    policy.move(2 * data.size());
+}
+
+template<typename RandomIt, typename Compare>
+void quick_sort_extra(RandomIt first, RandomIt last, Compare comp, WorkStealingPool &pool) {
+    if (last - first < 2) return;
+    NoSortMetrics none;
+    quick_sort_extra(first, last, comp, &pool, none, contiguous_iterator<RandomIt>());
+}
+
+template<typename RandomIt, typename Compare = std::less<typename std::iterator_traits<RandomIt>::value_type>>
+void quick_sort_extra(RandomIt first, RandomIt last, Compare comp = Compare()) {
+    if (last - first < 2) return;
+    WorkStealingPool *pool = last - first >= PARALLEL_PARTITION_THRESHOLD ? &WorkStealingPool::shared() : nullptr;
+    NoSortMetrics none;
+    quick_sort_extra(first, last, comp, pool, none, contiguous_iterator<RandomIt>());
+}
+
+// EFFECTS: quick_sort_extra reporting to policy, always on the calling thread
+template<typename RandomIt, typename Compare, typename Policy>
+void quick_sort_extra(RandomIt first, RandomIt last, Compare comp, Policy &policy) {
+    policy.begin("quick_sort_extra", (size_t) (last - first));
+    if (last - first >= 2) {
+        quick_sort_extra(first, last, instrument_compare(comp, policy), nullptr, metrics_ref(policy),
+                         contiguous_iterator<RandomIt>());
+    }
+    policy.end();
+}
+
+template<typename T, typename Compare>
+void quick_sort_extra(std::vector<T> &vector, Compare comp, WorkStealingPool &pool) {
+    quick_sort_extra(vector.begin(), vector.end(), comp, pool);
+}
+
+template<typename T, typename Compare>
+void quick_sort_extra(std::vector<T> &vector, Compare comp = std::less<T>()) {
+    quick_sort_extra(vector.begin(), vector.end(), comp);
+}
+
+template<typename T, typename Compare, typename Policy>
+void quick_sort_extra(std::vector<T> &vector, Compare comp, Policy &policy) {
+    quick_sort_extra(vector.begin(), vector.end(), comp, policy);
+}
+
+// below this many elements quick_sort_inplace finishes with insertion_sort
+const int QUICK_SORT_INSERTION_THRESHOLD = 24;
+// above this many elements the pivot is the ninther (median of three medians of three)
+const int QUICK_SORT_NINTHER_THRESHOLD = 128;
+// partial_insertion_sort gives up after moving this many elements
+const int PARTIAL_INSERTION_SORT_LIMIT = 8;
+
+// EFFECTS: order data[a], data[b], data[c] so that data[a] <= data[b] <= data[c]
+template<typename RandomIt, typename Compare, typename Policy>
+void sort3(RandomIt data, ptrdiff_t a, ptrdiff_t b, ptrdiff_t c, Compare comp, Policy policy) {
+    if (comp(data[b], data[a])) policy_swap(data[a], data[b], policy);
+    if (comp(data[c], data[b])) policy_swap(data[b], data[c], policy);
+    if (comp(data[b], data[a])) policy_swap(data[a], data[b], policy);
+}
+
+// EFFECTS: insertion sort of data[left..right] which gives up (returning false) once more than
+//          PARTIAL_INSERTION_SORT_LIMIT elements were moved
+template<typename RandomIt, typename Compare, typename Policy>
+bool partial_insertion_sort(RandomIt data, ptrdiff_t left, ptrdiff_t right, Compare comp, Policy policy) {
+    typedef typename std::iterator_traits<RandomIt>::value_type T;
+    ptrdiff_t moved = 0;
+    for (ptrdiff_t i = left + 1; i <= right; i++) {
+        if (!comp(data[i], data[i - 1])) continue;
+        T temp = std::move(data[i]);
+        ptrdiff_t index = i - 1;
+        while (index >= left && comp(temp, data[index])) {
+            data[index + 1] = std::move(data[index]);
+            index--;
+        }
+        data[index + 1] = std::move(temp);
+        moved += i - index - 1;
+        policy.move((size_t) (i - index) + 1);
+        if (moved > PARTIAL_INSERTION_SORT_LIMIT) return false;
+    }
+    return true;
+}
+
+// EFFECTS: partition data[left + 1..right] around the pivot data[left], elements equal to it go
+//          right; the pivot ends up at the returned position, and alreadyPartitioned tells whether
+//          no element had to be swapped. Needs an element >= pivot in data[right - 2..right],
+//          which the median of three / ninther guarantees, so the left scan needs no bound check
+template<typename RandomIt, typename Compare, typename Policy>
+ptrdiff_t partition_right(RandomIt data, ptrdiff_t left, ptrdiff_t right, bool &alreadyPartitioned, Compare comp,
+                          Policy policy, std::false_type) {
+    typedef typename std::iterator_traits<RandomIt>::value_type T;
+    T p(std::move(data[left]));
+    ptrdiff_t i = left, j = right + 1;
+    while (comp(data[++i], p));
+    if (i - 1 == left) {
+        while (i < j && !comp(data[--j], p));
+    } else {
+        while (!comp(data[--j], p));
+    }
+    alreadyPartitioned = i >= j;
+    while (i < j) {
+        policy_swap(data[i], data[j], policy);
+        while (comp(data[++i], p));
+        while (!comp(data[--j], p));
+    }
+    if (i - 1 != left) {
+        data[left] = std::move(data[i - 1]);
+        policy.move(1);
+    }
+    data[i - 1] = std::move(p);
+    policy.move(2);
+    return i - 1;
+}
+
+// elements classified per block by partition_right for arithmetic keys
+const int PARTITION_BLOCK_SIZE = 64;
+
+// EFFECTS: whether partition_right may classify blocks with branch-free comparisons,
+//          i.e. the comparison is a plain < or > on an arithmetic type
+template<typename T, typename Compare>
+struct branchless_partition : std::integral_constant<bool, std::is_arithmetic<T>::value && (
+        std::is_same<Compare, std::less<T>>::value || std::is_same<Compare, std::greater<T>>::value ||
+        std::is_same<Compare, std::less<>>::value || std::is_same<Compare, std::greater<>>::value)> {
+};
+
+// EFFECTS: swap num misplaced elements, left[offsetsL[i]] with right[-offsetsR[i]]; when the two
+//          lists are of different length the elements are rotated through one cycle instead
+template<typename T>
+void swap_offsets(T *left, T *right, const unsigned char *offsetsL, const unsigned char *offsetsR,
+                  int num, bool useSwaps) {
+    if (useSwaps) {
+        for (int i = 0; i < num; i++) mySwap(left[offsetsL[i]], right[-(int) offsetsR[i]]);
+    } else if (num > 0) {
+        T *l = left + offsetsL[0];
+        T *r = right - offsetsR[0];
+        T temp = *l;
+        *l = *r;
+        for (int i = 1; i < num; i++) {
+            l = left + offsetsL[i];
+            *r = *l;
+            r = right - offsetsR[i];
+            *l = *r;
+        }
+        *r = temp;
+    }
+}
+
+// EFFECTS: same contract as partition_right above, but as a BlockQuicksort partition: the offsets of
+//          misplaced elements of a block from each side are collected with branch-free comparisons
+//          (the comparison result is added to a counter instead of being branched on), then the
+//          collected elements are swapped in bulk, so the only branches left are well predicted.
+//          Only taken for plain < / >, never under a counting comparator, so it reports nothing
+template<typename T, typename Compare, typename Policy>
+ptrdiff_t partition_right(T *data, ptrdiff_t left, ptrdiff_t right, bool &alreadyPartitioned, Compare comp,
+                          Policy, std::true_type) {
+    T p = data[left];
+    T *first = data + left;
+    T *last = data + right + 1;
+    while (comp(*++first, p));
+    if (first - 1 == data + left) {
+        while (first < last && !comp(*--last, p));
+    } else {
+        while (!comp(*--last, p));
+    }
+    alreadyPartitioned = first >= last;
+    if (!alreadyPartitioned) {
+        mySwap(*first, *last);
+        ++first;
+        alignas(64) unsigned char offsetsL[PARTITION_BLOCK_SIZE];
+        alignas(64) unsigned char offsetsR[PARTITION_BLOCK_SIZE];
+        T *baseL = first;
+        T *baseR = last;
+        int numL = 0, numR = 0, startL = 0, startR = 0;
+        while (first < last) {
+            int unknown = (int) (last - first);
+            int leftSplit = numL == 0 ? (numR == 0 ? unknown / 2 : unknown) : 0;
+            int rightSplit = numR == 0 ? unknown - leftSplit : 0;
+            if (leftSplit > PARTITION_BLOCK_SIZE) leftSplit = PARTITION_BLOCK_SIZE;
+            if (rightSplit > PARTITION_BLOCK_SIZE) rightSplit = PARTITION_BLOCK_SIZE;
+            for (int i = 0; i < leftSplit; i++) {
+                offsetsL[numL] = (unsigned char) i;
+                numL += !comp(*first, p);
+                ++first;
+            }
+            for (int i = 0; i < rightSplit;) {
+                offsetsR[numR] = (unsigned char) ++i;
+                numR += comp(*--last, p);
+            }
+            int num = std::min(numL, numR);
+            swap_offsets(baseL, baseR, offsetsL + startL, offsetsR + startR, num, numL == numR);
+            numL -= num;
+            numR -= num;
+            startL += num;
+            startR += num;
+            if (numL == 0) {
+                startL = 0;
+                baseL = first;
+            }
+            if (numR == 0) {
+                startR = 0;
+                baseR = last;
+            }
+        }
+        // the leftovers of one side are moved to the border between the two groups
+        if (numL) {
+            while (numL--) mySwap(baseL[offsetsL[startL + numL]], *--last);
+            first = last;
+        }
+        if (numR) {
+            while (numR--) mySwap(baseR[-(int) offsetsR[startR + numR]], *first), ++first;
+        }
+    }
+    T *pivot = first - 1;
+    data[left] = *pivot;
+    *pivot = p;
+    return pivot - data;
+}
+
+// EFFECTS: Dijkstra three way partition around data[left]:
+//          data[left..lt - 1] < pivot, data[lt..gt] equivalent to it, data[gt + 1..right] > pivot
+template<typename RandomIt, typename Compare, typename Policy>
+void partition_three_way(RandomIt data, ptrdiff_t left, ptrdiff_t right, ptrdiff_t &lt, ptrdiff_t &gt, Compare comp,
+                         Policy policy) {
+    typename std::iterator_traits<RandomIt>::value_type p(std::move(data[left]));
+    ptrdiff_t i = left + 1;
+    lt = left;
+    gt = right;
+    // data[lt] is the hole the pivot was moved out of, data[lt + 1..i - 1] are equivalent to it;
+    // a smaller element fills the hole and the first equivalent one moves up to make the next
+    while (i <= gt) {
+        if (comp(data[i], p)) {
+            data[lt] = std::move(data[i]);
+            policy.move(1);
+            if (++lt != i) {
+                data[i] = std::move(data[lt]);
+                policy.move(1);
+            }
+            i++;
+        } else if (comp(p, data[i])) policy_swap(data[i], data[gt--], policy);
+        else i++;
+    }
+    data[lt] = std::move(p);
+    policy.move(2);
+}
+
+// EFFECTS: swap the elements at both ends of one side of a bad partition, data[left..right], with
+//          elements a quarter of the way in, to break patterns which keep producing bad pivots
+template<typename RandomIt, typename Policy>
+void break_side_patterns(RandomIt data, ptrdiff_t left, ptrdiff_t right, Policy policy) {
+    ptrdiff_t size = right - left + 1;
+    if (size < QUICK_SORT_INSERTION_THRESHOLD) return;
+    policy_swap(data[left], data[left + size / 4], policy);
+    policy_swap(data[right], data[right - size / 4], policy);
+    if (size > QUICK_SORT_NINTHER_THRESHOLD) {
+        policy_swap(data[left + 1], data[left + size / 4 + 1], policy);
+        policy_swap(data[left + 2], data[left + size / 4 + 2], policy);
+        policy_swap(data[right - 1], data[right - size / 4 - 1], policy);
+        policy_swap(data[right - 2], data[right - size / 4 - 2], policy);
+    }
+}
+
+// EFFECTS: pattern-defeating quick sort of data[left..right]: ninther pivots, recursion on the
+//          smaller side only (O(log n) stack), heap_sort once badAllowed unbalanced partitions
+//          were seen (O(n log n) worst case), and an early exit through partial_insertion_sort
+//          when a partition needed no swaps, so sorted and reverse sorted runs are linear;
+//          switches to a three way partition when the pivot equals the previous pivot
+template<typename RandomIt, typename Compare, typename Policy>
+void quick_sort_inplace_helper(RandomIt data, ptrdiff_t left, ptrdiff_t right, int badAllowed, Compare comp,
+                               Policy policy) {
+    typedef typename std::iterator_traits<RandomIt>::value_type T;
+    SortRecursion<Policy> recursion(policy);
+    while (true) {
+        ptrdiff_t size = right - left + 1;
+        if (size < QUICK_SORT_INSERTION_THRESHOLD || (size <= SIMD_NETWORK_MAX && simd_network_sortable<T, Compare>::value)) {
+            SortPhaseScope<Policy> phase(policy, SortPhase::Leaf);
+            if (size <= SIMD_NETWORK_MAX && simd_network_sort(data + left, (int) size, comp)) return;
+            if (size < QUICK_SORT_INSERTION_THRESHOLD) {
+                insertion_sort_helper(data + left, data + right + 1, comp, policy);
+                return;
+            }
+        }
+        policy.phase_begin(SortPhase::Partition);
+        ptrdiff_t mid = left + size / 2;
+        if (size > QUICK_SORT_NINTHER_THRESHOLD) {
+            sort3(data, left, mid, right, comp, policy);
+            sort3(data, left + 1, mid - 1, right - 1, comp, policy);
+            sort3(data, left + 2, mid + 1, right - 2, comp, policy);
+            sort3(data, mid - 1, mid, mid + 1, comp, policy);
+            policy_swap(data[left], data[mid], policy);
+        } else {
+            sort3(data, mid, left, right, comp, policy);
+        }
+        // the element before the range is a previous pivot, so if it is not less than this pivot,
+        // the pivot is the smallest key of the range and appears at least twice
+        if (left > 0 && !comp(data[left - 1], data[left])) {
+            // fat pivot: keys equal to the pivot are final and drop out of the recursion,
+            // so k distinct keys take O(n log k)
+            ptrdiff_t lt, gt;
+            partition_three_way(data, left, right, lt, gt, comp, policy);
+            policy.phase_end(SortPhase::Partition);
+            policy.partition((size_t) (lt - left), (size_t) (right - gt));
+            // nothing in the range is less than a pivot equal to the previous one, so the left side
+            // is empty and the partition is bad when fewer than 1/8 of the keys equal the pivot
+            if (right - gt > size - size / 8) {
+                if (--badAllowed == 0) {
+                    heap_sort_helper(data + gt + 1, data + right + 1, comp, policy);
+                    return;
+                }
+                break_side_patterns(data, gt + 1, right, policy);
+            }
+            if (lt - left < right - gt) {
+                quick_sort_inplace_helper(data, left, lt - 1, badAllowed, comp, policy);
+                left = gt + 1;
+            } else {
+                quick_sort_inplace_helper(data, gt + 1, right, badAllowed, comp, policy);
+                right = lt - 1;
+            }
+            continue;
+        }
+        bool alreadyPartitioned;
+        ptrdiff_t pivot = partition_right(data, left, right, alreadyPartitioned, comp, policy, std::integral_constant<bool,
+                branchless_partition<T, Compare>::value && std::is_pointer<RandomIt>::value>());
+        ptrdiff_t leftSize = pivot - left;
+        ptrdiff_t rightSize = right - pivot;
+        policy.phase_end(SortPhase::Partition);
+        policy.partition((size_t) leftSize, (size_t) rightSize);
+        if (leftSize < size / 8 || rightSize < size / 8) {
+            if (--badAllowed == 0) {
+                heap_sort_helper(data + left, data + right + 1, comp, policy);
+                return;
+            }
+            break_side_patterns(data, left, pivot - 1, policy);
+            break_side_patterns(data, pivot + 1, right, policy);
+        } else if (alreadyPartitioned &&
+                   partial_insertion_sort(data, left, pivot - 1, comp, policy) &&
+                   partial_insertion_sort(data, pivot + 1, right, comp, policy)) {
+            return;
+        }
+        if (leftSize < rightSize) {
+            quick_sort_inplace_helper(data, left, pivot - 1, badAllowed, comp, policy);
+            left = pivot + 1;
+        } else {
+            quick_sort_inplace_helper(data, pivot + 1, right, badAllowed, comp, policy);
+            right = pivot - 1;
+        }
+    }
+}
+
+template<typename RandomIt, typename Compare, typename Policy>
+void quick_sort_inplace_helper(RandomIt first, RandomIt last, Compare comp, Policy policy) {
+    ptrdiff_t size = last - first;
+    if (size < 2) return;
+    int badAllowed = 1;
+    for (ptrdiff_t n = size; n > 1; n >>= 1) badAllowed++;
+    quick_sort_inplace_helper(unwrap_iterator(first), 0, size - 1, badAllowed, comp, policy);
+}
+
+template<typename RandomIt, typename Compare = std::less<typename std::iterator_traits<RandomIt>::value_type>>
+void quick_sort_inplace(RandomIt first, RandomIt last, Compare comp = Compare()) {
+    NoSortMetrics none;
+    quick_sort_inplace_helper(first, last, comp, none);
+}
+
+template<typename RandomIt, typename Compare, typename Policy>
+void quick_sort_inplace(RandomIt first, RandomIt last, Compare comp, Policy &policy) {
+    policy.begin("quick_sort_inplace", (size_t) (last - first));
+    quick_sort_inplace_helper(first, last, instrument_compare(comp, policy), metrics_ref(policy));
+    policy.end();
+}
+
+template<typename T, typename Compare>
+void quick_sort_inplace(std::vector<T> &vector, int left, int right, Compare comp = std::less<T>()) {
+    if (left < right) quick_sort_inplace(vector.begin() + left, vector.begin() + right + 1, comp);
+}
+
+template<typename T, typename Compare>
+void quick_sort_inplace(std::vector<T> &vector, Compare comp = std::less<T>()) {
+    quick_sort_inplace(vector.begin(), vector.end(), comp);
+}
+
+template<typename T, typename Compare, typename Policy>
+void quick_sort_inplace(std::vector<T> &vector, Compare comp, Policy &policy) {
+    quick_sort_inplace(vector.begin(), vector.end(), comp, policy);
+}
+
+// number of buckets of parallel_sample_sort, a power of two
+const int SAMPLE_SORT_BUCKETS = 256;
+// samples taken per bucket to pick the splitters
+const int SAMPLE_SORT_OVERSAMPLING = 16;
+
+// EFFECTS: store the sorted splitters[lo..hi] as an implicit binary search tree (children of
+//          node j are 2j and 2j + 1) so classification needs no branches on the comparisons
+template<typename T>
+void build_splitter_tree(const std::vector<T> &splitters, std::vector<T> &tree, int node, int lo, int hi) {
+    if (lo > hi) return;
+    int mid = (lo + hi) / 2;
+    tree[node] = splitters[mid];
+    build_splitter_tree(splitters, tree, 2 * node, lo, mid - 1);
+    build_splitter_tree(splitters, tree, 2 * node + 1, mid + 1, hi);
+}
+
+// EFFECTS: parallel super scalar sample sort: splitters are picked from a sorted random sample,
+//          every element is classified by walking the splitter tree with the comparison result as
+//          the next index (no branches), blocks of the input count and then move their elements
+//          into the buckets of a second array in parallel, and every bucket is sorted with
+//          quick_sort_inplace as its own task. The data is read twice and written once before the
+//          buckets are sorted in cache, and the second array simply replaces vector at the end.
+//          When the sample repeats a splitter, the duplicates are dropped and every splitter gets
+//          an equality bucket of its own (one more comparison per element), which needs no sorting;
+//          otherwise a key filling a large part of the input would end up in one bucket sorted by
+//          one thread. Elements are moved, only the sample and the splitters are copies, so a
+//          move-only T is sorted by the parallel quick_sort_extra instead
+template<typename T, typename Compare>
+void parallel_sample_sort(std::vector<T> &vector, Compare comp, WorkStealingPool &pool, std::false_type) {
+    quick_sort_extra(vector, comp, pool);
+}
+
+template<typename T, typename Compare>
+void parallel_sample_sort(std::vector<T> &vector, Compare comp, WorkStealingPool &pool, std::true_type) {
+    size_t size = vector.size();
+    if (size < (size_t) SAMPLE_SORT_BUCKETS * SAMPLE_SORT_OVERSAMPLING * 16 || size < (size_t) PARALLEL_SORT_GRAIN) {
+        quick_sort_inplace(vector, comp);
+        return;
+    }
+
+    std::vector<T> sample;
+    sample.reserve(SAMPLE_SORT_BUCKETS * SAMPLE_SORT_OVERSAMPLING);
+    std::mt19937_64 random(size);
+    for (int i = 0; i < SAMPLE_SORT_BUCKETS * SAMPLE_SORT_OVERSAMPLING; i++) sample.push_back(vector[random() % size]);
+    quick_sort_inplace(sample, comp);
+    std::vector<T> splitters;
+    splitters.reserve(SAMPLE_SORT_BUCKETS - 1);
+    for (int i = 1; i < SAMPLE_SORT_BUCKETS; i++) {
+        const T &splitter = sample[i * SAMPLE_SORT_OVERSAMPLING - 1];
+        if (splitters.empty() || comp(splitters.back(), splitter)) splitters.push_back(splitter);
+    }
+    sample = std::vector<T>();
+    const bool equalBuckets = splitters.size() < (size_t) SAMPLE_SORT_BUCKETS - 1;
+    if (equalBuckets) {
+        // 2k buckets have to fit the one byte oracle
+        while (splitters.size() >= (size_t) SAMPLE_SORT_BUCKETS / 2) {
+            for (size_t i = 0; 2 * i + 1 < splitters.size(); i++) splitters[i] = splitters[2 * i + 1];
+            splitters.resize(splitters.size() / 2);
+        }
+    }
+    // the tree needs 2^logK - 1 splitters, the last one is repeated to fill it up
+    int logK = 0;
+    while ((size_t) (1 << logK) <= splitters.size()) logK++;
+    const int k = 1 << logK;
+    while (splitters.size() < (size_t) k - 1) splitters.push_back(splitters.back());
+    std::vector<T> tree(splitters);
+    tree.push_back(splitters[0]);
+    build_splitter_tree(splitters, tree, 1, 0, k - 2);
+    const int bucketCount = equalBuckets ? 2 * k : k;
+
+    size_t blocks = std::min(size / PARALLEL_SORT_GRAIN, pool.size() * 4);
+    if (blocks == 0) blocks = 1;
+    std::vector<unsigned char> oracle(size);
+    std::vector<size_t> count(blocks * bucketCount, 0);
+    auto blockBegin = [&](size_t block) { return size * block / blocks; };
+    {
+        TaskGroup group(pool);
+        for (size_t block = 0; block < blocks; block++) {
+            group.run([&, block] {
+                size_t *histogram = &count[block * bucketCount];
+                for (size_t i = blockBegin(block); i < blockBegin(block + 1); i++) {
+                    int j = 1;
+                    for (int level = 0; level < logK; level++) j = 2 * j + (comp(tree[j], vector[i]) ? 1 : 0);
+                    j -= k;
+                    // splitters[j - 1] < vector[i] <= splitters[j], so it equals splitters[j] unless less
+                    if (equalBuckets) j = 2 * j + (j < k - 1 && !comp(vector[i], splitters[j]) ? 1 : 0);
+                    oracle[i] = (unsigned char) j;
+                    histogram[j]++;
+                }
+            });
+        }
+        group.wait();
+    }
+
+    // offsets ordered by bucket first and block second, so every block owns a slice of every bucket
+    std::vector<size_t> bucketBegin(bucketCount + 1);
+    size_t sum = 0;
+    for (int b = 0; b < bucketCount; b++) {
+        bucketBegin[b] = sum;
+        for (size_t block = 0; block < blocks; block++) {
+            size_t c = count[block * bucketCount + b];
+            count[block * bucketCount + b] = sum;
+            sum += c;
+        }
+    }
+    bucketBegin[bucketCount] = sum;
+
+    std::vector<T> buckets = scratch_buffer(vector.begin(), vector.end());
+    {
+        TaskGroup group(pool);
+        for (size_t block = 0; block < blocks; block++) {
+            group.run([&, block] {
+                size_t *offset = &count[block * bucketCount];
+                for (size_t i = blockBegin(block); i < blockBegin(block + 1); i++) {
+                    buckets[offset[oracle[i]]++] = std::move(vector[i]);
+                }
+            });
+        }
+        group.wait();
+    }
+    {
+        TaskGroup group(pool);
+        for (int b = 0; b < bucketCount; b++) {
+            if (bucketBegin[b + 1] - bucketBegin[b] < 2 || (equalBuckets && b % 2 == 1)) continue;
+            group.run([&, b] {
+                quick_sort_inplace(buckets.begin() + bucketBegin[b], buckets.begin() + bucketBegin[b + 1], comp);
+            });
+        }
+        group.wait();
+    }
+    vector.swap(buckets);
+}
+
+template<typename T, typename Compare>
+void parallel_sample_sort(std::vector<T> &vector, Compare comp, WorkStealingPool &pool) {
+    parallel_sample_sort(vector, comp, pool, std::is_copy_constructible<T>());
+}
+
+template<typename T, typename Compare>
+void parallel_sample_sort(std::vector<T> &vector, Compare comp = std::less<T>()) {
+    parallel_sample_sort(vector, comp, WorkStealingPool::shared());
+}
+
+// function objects which run one of the six sorts on an iterator range, for the entry points that
+// let the caller pick the algorithm (templates cannot be passed as arguments themselves)
+struct BubbleSorter {
+    template<typename RandomIt, typename Compare>
+    void operator()(RandomIt first, RandomIt last, Compare comp) const { bubble_sort(first, last, comp); }
+};
+
+struct InsertionSorter {
+    template<typename RandomIt, typename Compare>
+    void operator()(RandomIt first, RandomIt last, Compare comp) const { insertion_sort(first, last, comp); }
+};
+
+struct SelectionSorter {
+    template<typename RandomIt, typename Compare>
+    void operator()(RandomIt first, RandomIt last, Compare comp) const { selection_sort(first, last, comp); }
+};
+
+struct MergeSorter {
+    template<typename RandomIt, typename Compare>
+    void operator()(RandomIt first, RandomIt last, Compare comp) const { merge_sort(first, last, comp); }
+};
+
+struct QuickSortExtraSorter {
+    template<typename RandomIt, typename Compare>
+    void operator()(RandomIt first, RandomIt last, Compare comp) const { quick_sort_extra(first, last, comp); }
+};
+
+struct QuickSortInplaceSorter {
+    template<typename RandomIt, typename Compare>
+    void operator()(RandomIt first, RandomIt last, Compare comp) const { quick_sort_inplace(first, last, comp); }
+};
+
+// EFFECTS: compares two positions of a range by the elements at them
+template<typename RandomIt, typename Compare>
+struct index_less {
+    RandomIt first;
+    Compare comp;
+
+    bool operator()(size_t a, size_t b) const { return comp(first[a], first[b]); }
+};
+
+// EFFECTS: the permutation which sorts [first, last): order[i] is the position of the element that
+//          belongs at i. The elements are not touched, only the index array is sorted, by sorter
+//          (MergeSorter gives a stable order)
+template<typename RandomIt, typename Compare, typename Sorter = QuickSortInplaceSorter>
+std::vector<size_t> argsort(RandomIt first, RandomIt last, Compare comp, Sorter sorter = Sorter()) {
+    std::vector<size_t> order((size_t) (last - first));
+    for (size_t i = 0; i < order.size(); i++) order[i] = i;
+    sorter(order.begin(), order.end(), index_less<RandomIt, Compare>{first, comp});
+    return order;
+}
+
+template<typename T, typename Compare, typename Sorter = QuickSortInplaceSorter>
+std::vector<size_t> argsort(const std::vector<T> &vector, Compare comp, Sorter sorter = Sorter()) {
+    return argsort(vector.begin(), vector.end(), comp, sorter);
+}
+
+// EFFECTS: rearrange [first, last) so that the element at order[i] ends up at i, by walking the
+//          cycles of the permutation: every element is moved exactly once, plus one temporary per
+//          cycle. order is used to mark finished positions and is the identity afterwards
+template<typename RandomIt>
+void apply_permutation(RandomIt first, RandomIt last, std::vector<size_t> &order) {
+    typedef typename std::iterator_traits<RandomIt>::value_type T;
+    size_t size = (size_t) (last - first);
+    if (order.size() != size) throw std::invalid_argument("apply_permutation: order does not match the range");
+    for (size_t start = 0; start < size; start++) {
+        if (order[start] == start) continue;
+        T temp = std::move(first[start]);
+        size_t hole = start;
+        while (order[hole] != start) {
+            size_t next = order[hole];
+            first[hole] = std::move(first[next]);
+            order[hole] = hole;
+            hole = next;
+        }
+        first[hole] = std::move(temp);
+        order[hole] = hole;
+    }
+}
+
+// EFFECTS: sort [first, last) through its permutation: sorter only moves indices, then every element
+//          is moved once, which pays off for large records whose swaps move a lot of memory
+template<typename RandomIt, typename Compare, typename Sorter = QuickSortInplaceSorter>
+void indirect_sort(RandomIt first, RandomIt last, Compare comp, Sorter sorter = Sorter()) {
+    std::vector<size_t> order = argsort(first, last, comp, sorter);
+    apply_permutation(first, last, order);
+}
+
+template<typename T, typename Compare, typename Sorter = QuickSortInplaceSorter>
+void indirect_sort(std::vector<T> &vector, Compare comp, Sorter sorter = Sorter()) {
+    indirect_sort(vector.begin(), vector.end(), comp, sorter);
+}
+
+// rows of the payload columns zip_sort gathers per block, so that the block of the permutation
+// stays in cache while it is applied to every column
+const size_t ZIP_SORT_BLOCK = 4096;
+
+// EFFECTS: the kernel sort_rows uses on (key, row) pairs: 2 is radix_sort for integral / floating point
+//          keys, 1 is msd_radix_sort for tuples of them (both under std::less), 0 is quick_sort_inplace;
+//          both radix sorts encode -0.0 as +0.0, so signed zeros keep their row order like equal keys
+template<typename Key, typename Compare, bool Less = std::is_same<Compare, std::less<Key>>::value ||
+                                                     std::is_same<Compare, std::less<>>::value>
+struct row_kernel : std::integral_constant<int, !Less ? 0 : radix_sortable_key<Key>::value ? 2 :
+                                                            radix_tuple<Key>::sortable ? 1 : 0> {
+};
+
+template<typename Key>
+struct row_key {
+    const Key &operator()(const std::pair<Key, size_t> &row) const { return row.first; }
+};
+
+// EFFECTS: the key of a row with the row index appended as the last tuple component
+template<typename Key>
+struct row_key_and_index {
+    auto operator()(const std::pair<Key, size_t> &row) const -> decltype(std::tuple_cat(row.first, std::make_tuple(row.second))) {
+        return std::tuple_cat(row.first, std::make_tuple(row.second));
+    }
+};
+
+template<typename Key, typename Compare>
+void sort_rows(std::vector<std::pair<Key, size_t>> &rows, Compare, std::integral_constant<int, 2>) {
+    radix_sort(rows, row_key<Key>());
+}
+
+template<typename Key, typename Compare>
+void sort_rows(std::vector<std::pair<Key, size_t>> &rows, Compare, std::integral_constant<int, 1>) {
+    msd_radix_sort(rows, row_key_and_index<Key>());
+}
+
+template<typename Key, typename Compare>
+void sort_rows(std::vector<std::pair<Key, size_t>> &rows, Compare comp, std::integral_constant<int, 0>) {
+    quick_sort_inplace(rows.begin(), rows.end(), [&](const std::pair<Key, size_t> &a, const std::pair<Key, size_t> &b) {
+        return comp(a.first, b.first) || (!comp(b.first, a.first) && a.second < b.second);
+    });
+}
+
+// EFFECTS: stable sort of (key, row index) pairs by key with the fastest kernel for the key type,
+//          ties are broken by the row index (LSD radix_sort is stable by itself)
+template<typename Key, typename Compare>
+void sort_rows(std::vector<std::pair<Key, size_t>> &rows, Compare comp) {
+    sort_rows(rows, comp, row_kernel<Key, Compare>());
+}
+
+// EFFECTS: append column[order[first..last - 1]] to result
+template<typename T>
+void zip_gather(std::vector<T> &column, std::vector<T> &result, const std::vector<size_t> &order,
+                size_t first, size_t last) {
+    for (size_t i = first; i < last; i++) result.push_back(std::move(column[order[i]]));
+}
+
+// EFFECTS: gather every payload column by order into its results vector and swap it in
+template<typename... Payload, size_t... Columns>
+void zip_sort_payload(std::tuple<std::vector<Payload>...> &results, const std::vector<size_t> &order,
+                      std::index_sequence<Columns...>, std::vector<Payload> &... payloads) {
+    int expand[] = {0, (std::get<Columns>(results).reserve(order.size()), 0)...};
+    for (size_t first = 0; first < order.size(); first += ZIP_SORT_BLOCK) {
+        size_t last = std::min(first + ZIP_SORT_BLOCK, order.size());
+        int gather[] = {0, (zip_gather(payloads, std::get<Columns>(results), order, first, last), 0)...};
+        (void) gather;
+        (void) last;
+    }
+    int swap[] = {0, (payloads.swap(std::get<Columns>(results)), 0)...};
+    (void) expand;
+    (void) swap;
+}
+
+/**
+ * Stable sort of a structure of arrays: keys is sorted by comp and every payload column is
+ * permuted the same way, all of them stay separate vectors
+ * The keys are packed with their row index and sorted once by sort_rows; then every payload
+ * column is gathered into a new vector, block by block of ZIP_SORT_BLOCK rows across all
+ * columns, and swapped in.
+ * Needs memory for one more copy of each column; throws if a column is not as long as keys
+ */
+template<typename Key, typename Compare, typename... Payload>
+void zip_sort(std::vector<Key> &keys, Compare comp, std::vector<Payload> &... payloads) {
+    size_t size = keys.size();
+    size_t sizes[] = {size, payloads.size()...};
+    for (size_t columnSize : sizes) {
+        if (columnSize != size) throw std::invalid_argument("zip_sort: columns of different length");
+    }
+    std::vector<std::pair<Key, size_t>> rows;
+    rows.reserve(size);
+    for (size_t i = 0; i < size; i++) rows.emplace_back(std::move(keys[i]), i);
+    sort_rows(rows, comp);
+    std::vector<size_t> order(size);
+    for (size_t i = 0; i < size; i++) {
+        keys[i] = std::move(rows[i].first);
+        order[i] = rows[i].second;
+    }
+    rows.clear();
+    rows.shrink_to_fit();
+    std::tuple<std::vector<Payload>...> results;
+    zip_sort_payload(results, order, std::index_sequence_for<Payload...>(), payloads...);
+}
+
+/**
+ * Sort [first, last) by key(element) compared with comp, computing every key exactly once
+ * (a Schwartzian transform): the keys go into a side buffer of (key, position) pairs, which
+ * sort_rows orders with the fastest kernel for the key type (radix sorts for arithmetic keys and
+ * tuples of them under std::less), and the elements are then moved once by apply_permutation.
+ * Meant for keys which are expensive to derive, key is called n times instead of O(n log n).
+ * Stable
+ */
+template<typename RandomIt, typename KeyOf, typename Compare = std::less<>>
+void sort_by_key(RandomIt first, RandomIt last, KeyOf key, Compare comp = Compare()) {
+    typedef typename std::decay<decltype(key(*first))>::type Key;
+    size_t size = (size_t) (last - first);
+    if (size < 2) return;
+    std::vector<std::pair<Key, size_t>> rows;
+    rows.reserve(size);
+    for (size_t i = 0; i < size; i++) rows.emplace_back(key(first[i]), i);
+    sort_rows(rows, comp);
+    std::vector<size_t> order(size);
+    for (size_t i = 0; i < size; i++) order[i] = rows[i].second;
+    rows.clear();
+    rows.shrink_to_fit();
+    apply_permutation(first, last, order);
+}
+
+template<typename T, typename KeyOf, typename Compare = std::less<>>
+void sort_by_key(std::vector<T> &vector, KeyOf key, Compare comp = Compare()) {
+    sort_by_key(vector.begin(), vector.end(), key, comp);
+}
+
+// above this many elements select_nth first narrows the range by selecting in a sample of it
+const ptrdiff_t FLOYD_RIVEST_THRESHOLD = 600;
+
+// EFFECTS: Floyd-Rivest selection of data[k] in data[left..right]: a sample window around the
+//          expected position of k is selected recursively, so the pivot is close to the k-th element
+//          and a partition leaves only O(n^(2/3)) elements around k; then a Hoare partition (equal keys
+//          stop both scans, so duplicates split evenly) with the pivot parked at data[left]
+template<typename RandomIt, typename Compare>
+void floyd_rivest_select(RandomIt data, ptrdiff_t left, ptrdiff_t right, ptrdiff_t k, Compare comp) {
+    while (right > left) {
+        if (right - left > FLOYD_RIVEST_THRESHOLD) {
+            double n = (double) (right - left + 1);
+            double i = (double) (k - left + 1);
+            double z = std::log(n);
+            double s = 0.5 * std::exp(2 * z / 3);
+            double sd = 0.5 * std::sqrt(z * s * (n - s) / n) * (i < n / 2 ? -1 : 1);
+            ptrdiff_t newLeft = std::max(left, (ptrdiff_t) (k - i * s / n + sd));
+            ptrdiff_t newRight = std::min(right, (ptrdiff_t) (k + (n - i) * s / n + sd));
+            floyd_rivest_select(data, newLeft, newRight, k, comp);
+        }
+        mySwap(data[left], data[k]);
+        ptrdiff_t i = left, j = right + 1;
+        while (true) {
+            while (++i <= right && comp(data[i], data[left]));
+            while (comp(data[left], data[--j]));
+            if (i >= j) break;
+            mySwap(data[i], data[j]);
+        }
+        if (j != left) mySwap(data[left], data[j]);
+        if (j == k) return;
+        if (j < k) left = j + 1;
+        else right = j - 1;
+    }
+}
+
+// EFFECTS: same contract as std::nth_element: *nth is the element a full sort would put there, no
+//          element before it is greater and none after it is smaller; expected n + min(k, n - k) + o(n)
+//          comparisons with Floyd-Rivest selection
+template<typename RandomIt, typename Compare = std::less<typename std::iterator_traits<RandomIt>::value_type>>
+void select_nth(RandomIt first, RandomIt nth, RandomIt last, Compare comp = Compare()) {
+    if (nth == last || last - first < 2) return;
+    floyd_rivest_select(unwrap_iterator(first), 0, last - first - 1, nth - first, comp);
+}
+
+template<typename T, typename Compare>
+void select_nth(std::vector<T> &vector, size_t k, Compare comp = std::less<T>()) {
+    if (k < vector.size()) select_nth(vector.begin(), vector.begin() + k, vector.end(), comp);
+}
+
+// EFFECTS: put the middle - first smallest elements of [first, last) in sorted order at the front,
+//          the rest are left in unspecified order behind them: select_nth, then quick_sort_inplace on
+//          the prefix, O(n + k log k)
+template<typename RandomIt, typename Compare = std::less<typename std::iterator_traits<RandomIt>::value_type>>
+void partial_sort_prefix(RandomIt first, RandomIt middle, RandomIt last, Compare comp = Compare()) {
+    if (middle == first) return;
+    if (middle != last) select_nth(first, middle - 1, last, comp);
+    quick_sort_inplace(first, middle, comp);
+}
+
+template<typename T, typename Compare>
+void partial_sort_prefix(std::vector<T> &vector, size_t k, Compare comp = std::less<T>()) {
+    k = std::min(k, vector.size());
+    partial_sort_prefix(vector.begin(), vector.begin() + k, vector.end(), comp);
+}
+
+/**
+ * Streaming top-k: keeps the k first elements under comp of everything added so far (use
+ * std::greater for the k largest) in a max-heap under comp, so the root is the one to evict next.
+ * Single elements cost O(log k) and only when they beat the root. A batch is cut down to its own
+ * top k with select_nth before the lock is taken, so threads can feed batches concurrently and
+ * only O(k log k) of the work is serialized; accumulators can also be merged.
+ */
+template<typename T, typename Compare = std::less<T>>
+class TopK {
+public:
+    explicit TopK(size_t k, Compare comp = Compare()) : k(k), comp(comp) {
+        heap.reserve(k);
+    }
+
+    TopK(const TopK &other) : k(other.k), comp(other.comp), heap(other.values()) {}
+
+    TopK &operator=(const TopK &) = delete;
+
+    /**
+     * Offer one element
+     * Time complexity: O(log k)
+     */
+    void push(T value) {
+        std::lock_guard<std::mutex> guard(lock);
+        offer(std::move(value));
+    }
+
+    /**
+     * Offer a batch, which is copied and reduced to its own top k without holding the lock
+     * Time complexity: O(n + k log k)
+     */
+    template<typename InputIt>
+    void push(InputIt first, InputIt last) {
+        std::vector<T> batch(first, last);
+        if (batch.size() > k) {
+            select_nth(batch.begin(), batch.begin() + k, batch.end(), comp);
+            batch.erase(batch.begin() + k, batch.end());
+        }
+        std::lock_guard<std::mutex> guard(lock);
+        for (T &value : batch) offer(std::move(value));
+    }
+
+    void merge(const TopK &other) {
+        std::vector<T> kept = other.values();
+        push(kept.begin(), kept.end());
+    }
+
+    // EFFECTS: the kept elements in sorted order
+    std::vector<T> result() const {
+        std::vector<T> sorted = values();
+        quick_sort_inplace(sorted.begin(), sorted.end(), comp);
+        return sorted;
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> guard(lock);
+        return heap.size();
+    }
+
+private:
+    size_t k;
+    Compare comp;
+    std::vector<T> heap;
+    mutable std::mutex lock;
+
+    std::vector<T> values() const {
+        std::lock_guard<std::mutex> guard(lock);
+        return heap;
+    }
+
+    // REQUIRES: lock is held
+    void offer(T value) {
+        if (heap.size() < k) {
+            heap.push_back(std::move(value));
+            size_t child = heap.size() - 1;
+            while (child > 0 && comp(heap[(child - 1) / 2], heap[child])) {
+                mySwap(heap[(child - 1) / 2], heap[child]);
+                child = (child - 1) / 2;
+            }
+        } else if (k > 0 && comp(value, heap[0])) {
+            heap[0] = std::move(value);
+            sift_down(heap.begin(), (ptrdiff_t) heap.size(), 0, comp);
+        }
+    }
+};
+
+// kernels the adaptive sort can dispatch to
+enum class SortKernel {
+    AlreadySorted, Reverse, Insertion, Tim, Radix, Multikey, Indirect, QuickInplace, QuickExtraParallel
+};
+
+inline const char *sort_kernel_name(SortKernel kernel) {
+    switch (kernel) {
+        case SortKernel::AlreadySorted: return "already_sorted";
+        case SortKernel::Reverse: return "reverse";
+        case SortKernel::Insertion: return "insertion_sort";
+        case SortKernel::Tim: return "tim_sort";
+        case SortKernel::Radix: return "radix_sort";
+        case SortKernel::Multikey: return "multikey_quick_sort";
+        case SortKernel::Indirect: return "indirect_sort";
+        case SortKernel::QuickInplace: return "quick_sort_inplace";
+        case SortKernel::QuickExtraParallel: return "quick_sort_extra";
+    }
+    return "unknown";
+}
+
+/**
+ * Thresholds of the adaptive sort, read once per call so they can be calibrated per machine at
+ * runtime with set_sort_thresholds. The ratios are the sampled ones of SortProfile.
+ */
+struct SortThresholds {
+    // at most this many elements: insertion sort, without sampling
+    size_t insertionMaxSize = 24;
+    // elements (and pairs) looked at to estimate runs, inversions and duplicates
+    size_t sampleSize = 256;
+    // run boundaries per adjacent pair at most this: the input is made of long runs, tim_sort
+    double longRunsRatio = 0.05;
+    // sampled duplicate ratio from which three-way partitioning of quick_sort_inplace wins
+    double duplicateRatio = 0.75;
+    // from this size arithmetic keys (std::string keys) under std::less go to radix_sort (multikey_quick_sort)
+    size_t radixMinSize = 512;
+    // from this size the parallel quick_sort_extra runs on WorkStealingPool::shared()
+    size_t parallelMinSize = size_t(1) << 17;
+    // elements at least this large are sorted through their permutation (indirect_sort)
+    size_t indirectMinBytes = 128;
+};
+
+namespace AdaptiveSort {
+    inline std::mutex &thresholds_lock() {
+        static std::mutex lock;
+        return lock;
+    }
+
+    inline SortThresholds &thresholds() {
+        static SortThresholds thresholds;
+        return thresholds;
+    }
+}
+
+inline SortThresholds sort_thresholds() {
+    std::lock_guard<std::mutex> guard(AdaptiveSort::thresholds_lock());
+    return AdaptiveSort::thresholds();
+}
+
+inline void set_sort_thresholds(const SortThresholds &thresholds) {
+    std::lock_guard<std::mutex> guard(AdaptiveSort::thresholds_lock());
+    AdaptiveSort::thresholds() = thresholds;
+}
+
+/**
+ * What the adaptive sort measured on its input
+ * runs: run boundaries (ascending / strictly descending switches) per adjacent pair in sampled
+ * windows, about 2/3 for random input and 0 for sorted or reversed input
+ * inversions: share of sampled pairs i < j with a[j] < a[i], 0 sorted, 0.5 random, 1 reversed
+ * duplicates: 1 - distinct / sampled elements
+ */
+struct SortProfile {
+    size_t size = 0;
+    size_t elementSize = 0;
+    const char *keyType = "";
+    double runs = 0;
+    double inversions = 0;
+    double duplicates = 0;
+};
+
+struct SortDecision {
+    SortProfile profile;
+    SortKernel kernel = SortKernel::Insertion;
+    const char *reason = "";
+};
+
+/**
+ * The most recent decisions of the adaptive sort, oldest first, shared by all threads
+ * Capacity 0 turns the recording off.
+ */
+class SortTrace {
+public:
+    static SortTrace &shared() {
+        static SortTrace trace;
+        return trace;
+    }
+
+    void record(const SortDecision &decision) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (capacity == 0) return;
+        if (recent.size() == capacity) recent.erase(recent.begin());
+        recent.push_back(decision);
+        counts[(size_t) decision.kernel]++;
+    }
+
+    std::vector<SortDecision> decisions() const {
+        std::lock_guard<std::mutex> guard(lock);
+        return recent;
+    }
+
+    // EFFECTS: the latest decision, false if there is none
+    bool last(SortDecision &decision) const {
+        std::lock_guard<std::mutex> guard(lock);
+        if (recent.empty()) return false;
+        decision = recent.back();
+        return true;
+    }
+
+    // EFFECTS: how many recorded sorts went to kernel since the last clear, including dropped ones
+    size_t count(SortKernel kernel) const {
+        std::lock_guard<std::mutex> guard(lock);
+        return counts[(size_t) kernel];
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> guard(lock);
+        recent.clear();
+        std::fill(std::begin(counts), std::end(counts), 0);
+    }
+
+    void set_capacity(size_t size) {
+        std::lock_guard<std::mutex> guard(lock);
+        capacity = size;
+        if (recent.size() > capacity) recent.erase(recent.begin(), recent.end() - capacity);
+    }
+
+private:
+    size_t capacity = 64;
+    std::vector<SortDecision> recent;
+    size_t counts[(size_t) SortKernel::QuickExtraParallel + 1] = {};
+    mutable std::mutex lock;
+};
+
+namespace AdaptiveSort {
+    // EFFECTS: whether comp orders like operator<, which the radix kernels assume
+    template<typename T, typename Compare>
+    struct natural_order : std::integral_constant<bool,
+            std::is_same<Compare, std::less<T>>::value || std::is_same<Compare, std::less<>>::value> {
+    };
+
+    template<typename T>
+    const char *key_type() {
+        return std::is_same<T, std::string>::value ? "string" : std::is_arithmetic<T>::value ? "arithmetic" : "other";
+    }
+
+    // EFFECTS: run boundaries per adjacent pair in windows spread evenly over [first, first + size),
+    //          a boundary being where an ascending run ends or a strictly descending one stops descending
+    template<typename RandomIt, typename Compare>
+    double sample_runs(RandomIt first, size_t size, size_t sample, Compare comp) {
+        const size_t WINDOWS = 16;
+        size_t window = std::max<size_t>(sample / WINDOWS, 3);
+        size_t boundaries = 0, pairs = 0;
+        for (size_t w = 0; w < WINDOWS; w++) {
+            size_t start = (size - window) * w / (WINDOWS - 1);
+            int direction = 0;
+            for (size_t i = start + 1; i < start + window; i++, pairs++) {
+                int step = comp(first[i], first[i - 1]) ? -1 : 1;
+                if (direction != 0 && step != direction) boundaries++;
+                direction = step;
+            }
+        }
+        return (double) boundaries / (double) pairs;
+    }
+
+    // EFFECTS: share of random pairs i < j with first[j] < first[i]
+    template<typename RandomIt, typename Compare>
+    double sample_inversions(RandomIt first, size_t size, size_t sample, Compare comp, std::minstd_rand &random) {
+        size_t inversions = 0;
+        for (size_t s = 0; s < sample; s++) {
+            size_t i = random() % size, j = random() % size;
+            if (i == j) j = (i + 1) % size;
+            if (i > j) std::swap(i, j);
+            if (comp(first[j], first[i])) inversions++;
+        }
+        return (double) inversions / (double) sample;
+    }
+
+    // EFFECTS: 1 - distinct / sample over one random position in each of sample equal strides,
+    //          the positions are argsorted so that no element is copied
+    template<typename RandomIt, typename Compare>
+    double sample_duplicates(RandomIt first, size_t size, size_t sample, Compare comp, std::minstd_rand &random) {
+        std::vector<size_t> positions(sample);
+        for (size_t s = 0; s < sample; s++) {
+            size_t begin = size * s / sample, end = size * (s + 1) / sample;
+            positions[s] = begin + random() % (end - begin);
+        }
+        quick_sort_inplace(positions.begin(), positions.end(), index_less<RandomIt, Compare>{first, comp});
+        size_t distinct = 1;
+        for (size_t s = 1; s < sample; s++) {
+            if (comp(first[positions[s - 1]], first[positions[s]])) distinct++;
+        }
+        return 1 - (double) distinct / (double) sample;
+    }
+
+    template<typename RandomIt, typename Compare>
+    bool fully_descending(RandomIt first, RandomIt last, Compare comp) {
+        for (RandomIt it = first + 1; it < last; ++it) {
+            if (comp(*(it - 1), *it)) return false;
+        }
+        return true;
+    }
+
+    // EFFECTS: profile [first, last) and pick a kernel, see sort(std::vector<T> &, Compare)
+    //          radix: radix_sort (or multikey_quick_sort) can run on the range
+    template<typename RandomIt, typename Compare>
+    SortDecision decide(RandomIt first, RandomIt last, Compare comp, const SortThresholds &thresholds, bool radix) {
+        typedef typename std::iterator_traits<RandomIt>::value_type T;
+        SortDecision decision;
+        SortProfile &profile = decision.profile;
+        profile.size = (size_t) (last - first);
+        profile.elementSize = sizeof(T);
+        profile.keyType = key_type<T>();
+        if (profile.size <= std::max<size_t>(thresholds.insertionMaxSize, 2)) {
+            decision.kernel = SortKernel::Insertion;
+            decision.reason = "small input";
+            return decision;
+        }
+        size_t sample = std::min(std::max<size_t>(thresholds.sampleSize, 16), profile.size);
+        std::minstd_rand random((unsigned) profile.size);
+        profile.runs = sample_runs(first, profile.size, sample, comp);
+        profile.inversions = sample_inversions(first, profile.size, sample, comp, random);
+        profile.duplicates = sample_duplicates(first, profile.size, sample, comp, random);
+        if (profile.runs <= thresholds.longRunsRatio) {
+            if (profile.inversions < 0.5 && std::is_sorted(first, last, comp)) {
+                decision.kernel = SortKernel::AlreadySorted;
+                decision.reason = "sorted";
+            } else if (profile.inversions > 0.5 && fully_descending(first, last, comp)) {
+                decision.kernel = SortKernel::Reverse;
+                decision.reason = "reverse sorted";
+            } else if (contiguous_iterator<RandomIt>::value) {
+                decision.kernel = SortKernel::Tim;
+                decision.reason = "long runs";
+            } else {
+                decision.kernel = SortKernel::QuickInplace;
+                decision.reason = "long runs, not contiguous for tim_sort";
+            }
+        } else if (profile.elementSize >= thresholds.indirectMinBytes) {
+            decision.kernel = SortKernel::Indirect;
+            decision.reason = "large elements";
+        } else if (profile.duplicates >= thresholds.duplicateRatio) {
+            decision.kernel = SortKernel::QuickInplace;
+            decision.reason = "few distinct keys";
+        } else if (radix && profile.size >= thresholds.radixMinSize) {
+            bool strings = std::is_same<T, std::string>::value;
+            decision.kernel = strings ? SortKernel::Multikey : SortKernel::Radix;
+            decision.reason = strings ? "string keys" : "arithmetic keys";
+        } else if (profile.size >= thresholds.parallelMinSize && std::thread::hardware_concurrency() > 1) {
+            decision.kernel = SortKernel::QuickExtraParallel;
+            decision.reason = "large input";
+        } else {
+            decision.kernel = SortKernel::QuickInplace;
+            decision.reason = "default";
+        }
+        return decision;
+    }
+
+    template<typename RandomIt, typename Compare>
+    void run_tim(RandomIt first, RandomIt last, Compare comp, std::true_type) {
+        typedef typename std::iterator_traits<RandomIt>::value_type T;
+        TimSorter<T, Compare>(unwrap_iterator(first), (size_t) (last - first), comp).sort();
+    }
+
+    template<typename RandomIt, typename Compare>
+    void run_tim(RandomIt first, RandomIt last, Compare comp, std::false_type) {
+        quick_sort_inplace(first, last, comp);
+    }
+
+    // EFFECTS: run a kernel which works on any iterator range (Radix and Multikey fall back to quick_sort_inplace)
+    template<typename RandomIt, typename Compare>
+    void run(SortKernel kernel, RandomIt first, RandomIt last, Compare comp) {
+        switch (kernel) {
+            case SortKernel::AlreadySorted: break;
+            case SortKernel::Reverse: std::reverse(first, last); break;
+            case SortKernel::Insertion: insertion_sort(first, last, comp); break;
+            case SortKernel::Tim: run_tim(first, last, comp, contiguous_iterator<RandomIt>()); break;
+            case SortKernel::Indirect: indirect_sort(first, last, comp); break;
+            case SortKernel::QuickExtraParallel:
+                quick_sort_extra(first, last, comp, WorkStealingPool::shared());
+                break;
+            default: quick_sort_inplace(first, last, comp); break;
+        }
+    }
+
+    template<typename T, typename Compare>
+    void run(SortKernel kernel, std::vector<T> &vector, Compare comp, std::true_type) {
+        if (kernel == SortKernel::Radix) radix_sort(vector);
+        else run(kernel, vector.begin(), vector.end(), comp);
+    }
+
+    template<typename Compare>
+    void run(SortKernel kernel, std::vector<std::string> &vector, Compare comp, std::true_type) {
+        if (kernel == SortKernel::Multikey) multikey_quick_sort(vector);
+        else run(kernel, vector.begin(), vector.end(), comp);
+    }
+
+    template<typename T, typename Compare>
+    void run(SortKernel kernel, std::vector<T> &vector, Compare comp, std::false_type) {
+        run(kernel, vector.begin(), vector.end(), comp);
+    }
+
+    template<typename T, typename Compare>
+    struct radix_kernel : std::integral_constant<bool, natural_order<T, Compare>::value &&
+            (radix_sortable_key<T>::value || std::is_same<T, std::string>::value)> {
+    };
+}
+
+/**
+ * Adaptive sort: samples the input and runs the kernel that suits it
+ *  - up to insertionMaxSize elements: insertion_sort
+ *  - long runs: nothing if sorted, a reversal if reverse sorted, tim_sort otherwise
+ *  - elements of indirectMinBytes or more: indirect_sort, so that only indices are swapped
+ *  - mostly duplicates: quick_sort_inplace, whose three-way partitions take out equal keys
+ *  - arithmetic or std::string keys under std::less: radix_sort / multikey_quick_sort
+ *  - parallelMinSize elements or more on a multi-core machine: parallel quick_sort_extra,
+ *    quick_sort_inplace otherwise
+ * Sampling costs O(sampleSize log sampleSize) comparisons; the sorted and reversed verdicts are
+ * checked on the whole input. Every decision is returned and recorded in SortTrace::shared().
+ * Every kernel only moves elements, so T may be move-only. Not stable.
+ */
+template<typename T, typename Compare>
+SortDecision sort(std::vector<T> &vector, Compare comp, const SortThresholds &thresholds) {
+    typedef AdaptiveSort::radix_kernel<T, Compare> Radix;
+    SortDecision decision = AdaptiveSort::decide(vector.begin(), vector.end(), comp, thresholds, Radix::value);
+    SortTrace::shared().record(decision);
+    AdaptiveSort::run(decision.kernel, vector, comp, Radix());
+    return decision;
+}
+
+template<typename T, typename Compare = std::less<T>>
+SortDecision sort(std::vector<T> &vector, Compare comp = Compare()) {
+    return sort(vector, comp, sort_thresholds());
+}
+
+// EFFECTS: the adaptive sort on an iterator range, which cannot be called sort without clashing with
+//          std::sort; radix_sort and multikey_quick_sort need a whole vector and are not considered
+template<typename RandomIt, typename Compare>
+SortDecision adaptive_sort(RandomIt first, RandomIt last, Compare comp, const SortThresholds &thresholds) {
+    SortDecision decision = AdaptiveSort::decide(first, last, comp, thresholds, false);
+    SortTrace::shared().record(decision);
+    AdaptiveSort::run(decision.kernel, first, last, comp);
+    return decision;
+}
+
+template<typename RandomIt, typename Compare = std::less<typename std::iterator_traits<RandomIt>::value_type>>
+SortDecision adaptive_sort(RandomIt first, RandomIt last, Compare comp = Compare()) {
+    return adaptive_sort(first, last, comp, sort_thresholds());
 }
 
 #endif //VE281P1_SORT_HPP
\ No newline at end of file
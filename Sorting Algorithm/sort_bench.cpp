@@ -0,0 +1,411 @@
+// Benchmark of the sorts in sort.hpp against std::sort / std::stable_sort
+// Every algorithm runs on every (type, distribution, size) it applies to and one row per run is
+// written as CSV or JSON on stdout, so the output of two builds can be diffed. Run with --help.
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "sort.hpp"
+
+using namespace std;
+
+// 64-byte record ordered by its key, the rest is payload that has to move along
+struct record {
+    int64_t key;
+    char payload[56];
+
+    bool operator<(const record &other) const { return key < other.key; }
+
+    bool operator==(const record &other) const {
+        return key == other.key && memcmp(payload, other.payload, sizeof(payload)) == 0;
+    }
+};
+
+static_assert(sizeof(record) == 64, "record is meant to be 64 bytes");
+
+struct benchOptions {
+    vector<size_t> sizes;
+    size_t maxSize = size_t(1) << 20;
+    size_t quadraticMax = 4096;
+    size_t maxBytes = size_t(2) << 30;
+    int repeat = 5;
+    uint64_t seed = 281;
+    bool json = false;
+    vector<string> types;
+    vector<string> distributions;
+    vector<string> algorithms;
+};
+
+struct benchResult {
+    string type;
+    string distribution;
+    size_t size;
+    string algorithm;
+    int runs;
+    double nsPerElement;
+    double minNsPerElement;
+    double bytesPerSecond;
+    bool ok;
+};
+
+const char *const DISTRIBUTIONS[] = {"random", "sorted", "reversed", "organ_pipe", "few_unique", "nearly_sorted",
+                                     "zipf"};
+
+// sizes benchmarked by default, up to --max-size
+const size_t SIZE_LADDER[] = {16, 256, 4096, 65536, size_t(1) << 20, size_t(1) << 24, 100000000};
+
+// keys are drawn from [0, KEY_RANGE) so that every type can represent them in order
+const uint64_t KEY_RANGE = uint64_t(1) << 31;
+
+// Zipf ranks are drawn from at most this many values, which bounds the CDF table
+const size_t ZIPF_MAX_RANKS = size_t(1) << 20;
+
+// small inputs are sorted in batches of copies, back to back, so that the clock is not read around
+// a sort of 16 elements: a batch holds at most this many elements and is cut short once one sort
+// alone takes BATCH_SECONDS (which keeps the quadratic sorts affordable)
+const size_t BATCH_ELEMENTS = size_t(1) << 16;
+const double BATCH_SECONDS = 1e-3;
+
+// EFFECTS: n keys of the distribution, all in [0, KEY_RANGE)
+//          nearly_sorted is sorted with n / 100 random swaps, few_unique has 16 distinct keys and
+//          zipf draws ranks with P(rank k) ~ 1 / (k + 1) scattered over the key range
+vector<uint64_t> make_keys(const string &distribution, size_t n, uint64_t seed) {
+    mt19937_64 random(seed ^ (n * 0x9e3779b97f4a7c15ULL) ^ hash<string>()(distribution));
+    vector<uint64_t> keys(n);
+    uint64_t step = max<uint64_t>(KEY_RANGE / max<size_t>(n, 1), 1);
+    if (distribution == "random") {
+        for (uint64_t &key : keys) key = random() % KEY_RANGE;
+    } else if (distribution == "sorted" || distribution == "nearly_sorted") {
+        for (size_t i = 0; i < n; i++) keys[i] = i * step % KEY_RANGE;
+        if (distribution == "nearly_sorted" && n > 1) {
+            for (size_t swaps = max<size_t>(n / 100, 1); swaps > 0; swaps--) {
+                std::swap(keys[random() % n], keys[random() % n]);
+            }
+        }
+    } else if (distribution == "reversed") {
+        for (size_t i = 0; i < n; i++) keys[i] = (n - 1 - i) * step % KEY_RANGE;
+    } else if (distribution == "organ_pipe") {
+        for (size_t i = 0; i < n; i++) keys[i] = (i < n / 2 ? i : n - 1 - i) * 2 * step % KEY_RANGE;
+    } else if (distribution == "few_unique") {
+        for (uint64_t &key : keys) key = random() % 16 * (KEY_RANGE / 16);
+    } else if (distribution == "zipf") {
+        size_t ranks = max<size_t>(min(n, ZIPF_MAX_RANKS), 1);
+        vector<double> cdf(ranks);
+        double sum = 0;
+        for (size_t k = 0; k < ranks; k++) cdf[k] = sum += 1.0 / (double) (k + 1);
+        uniform_real_distribution<double> uniform(0, sum);
+        for (uint64_t &key : keys) {
+            size_t rank = (size_t) (lower_bound(cdf.begin(), cdf.end(), uniform(random)) - cdf.begin());
+            // an odd multiplier permutes [0, KEY_RANGE), so frequent ranks land all over the range
+            key = min(rank, ranks - 1) * 0x9e3779b1ULL % KEY_RANGE;
+        }
+    } else {
+        throw invalid_argument("unknown distribution " + distribution);
+    }
+    return keys;
+}
+
+// EFFECTS: order preserving maps from a key onto each benchmarked type
+void convert(uint64_t key, int32_t &value) { value = (int32_t) ((int64_t) key - (int64_t) (KEY_RANGE / 2)); }
+
+void convert(uint64_t key, int64_t &value) {
+    // the low half is a function of the key, so the full 64 bits differ without changing the order
+    value = (int64_t) (key - KEY_RANGE / 2) * (int64_t(1) << 32) + (int64_t) ((key * 0x9e3779b1ULL) & 0xffffffffULL);
+}
+
+void convert(uint64_t key, double &value) { value = ((double) key - (double) (KEY_RANGE / 2)) * 1e-3; }
+
+void convert(uint64_t key, string &value) {
+    char text[32];
+    snprintf(text, sizeof(text), "user/%010llu", (unsigned long long) key);
+    value = text;
+}
+
+void convert(uint64_t key, record &value) {
+    convert(key, value.key);
+    memset(value.payload, (int) (key & 0xff), sizeof(value.payload));
+}
+
+// EFFECTS: bytes an element occupies, including the characters of a string
+template<typename T>
+size_t element_bytes(const T &) { return sizeof(T); }
+
+size_t element_bytes(const string &value) { return sizeof(string) + value.size(); }
+
+template<typename T>
+struct algorithm {
+    string name;
+    function<void(vector<T> &)> run;
+    bool quadratic;
+    size_t maxSize;
+};
+
+template<typename T>
+struct record_key {
+    const T &operator()(const T &value) const { return value; }
+};
+
+template<>
+struct record_key<record> {
+    int64_t operator()(const record &value) const { return value.key; }
+};
+
+template<typename T>
+void add_radix_sorts(vector<algorithm<T>> &list, std::true_type) {
+    list.push_back({"radix_sort", [](vector<T> &v) { radix_sort(v, record_key<T>()); }, false, SIZE_MAX});
+    list.push_back({"msd_radix_sort", [](vector<T> &v) { msd_radix_sort(v, record_key<T>()); }, false,
+                    (size_t) INT32_MAX});
+}
+
+template<typename T>
+void add_radix_sorts(vector<algorithm<T>> &, std::false_type) {}
+
+void add_string_sorts(vector<algorithm<string>> &list) {
+    list.push_back({"multikey_quick_sort", [](vector<string> &v) { multikey_quick_sort(v); }, false, SIZE_MAX});
+}
+
+template<typename T>
+void add_string_sorts(vector<algorithm<T>> &) {}
+
+// EFFECTS: every sort of sort.hpp that applies to T, plus std::sort and std::stable_sort
+template<typename T>
+vector<algorithm<T>> algorithms_for() {
+    typedef std::less<T> L;
+    vector<algorithm<T>> list = {
+            {"std_sort",              [](vector<T> &v) { std::sort(v.begin(), v.end(), L()); },           false, SIZE_MAX},
+            {"std_stable_sort",       [](vector<T> &v) { std::stable_sort(v.begin(), v.end(), L()); },    false, SIZE_MAX},
+            {"bubble_sort",           [](vector<T> &v) { bubble_sort(v, L()); },                          true,  SIZE_MAX},
+            {"insertion_sort",        [](vector<T> &v) { insertion_sort(v, L()); },                       true,  SIZE_MAX},
+            {"selection_sort",        [](vector<T> &v) { selection_sort(v, L()); },                       true,  SIZE_MAX},
+            {"merge_sort",            [](vector<T> &v) { merge_sort(v, L()); },                           false, SIZE_MAX},
+            {"merge_sort_bottom_up",  [](vector<T> &v) { merge_sort_bottom_up(v, L()); },                 false, SIZE_MAX},
+            {"parallel_merge_sort",   [](vector<T> &v) { parallel_merge_sort(v, L()); },                  false, SIZE_MAX},
+            {"tim_sort",              [](vector<T> &v) { tim_sort(v, L()); },                             false, SIZE_MAX},
+            {"heap_sort",             [](vector<T> &v) { heap_sort(v, L()); },                            false, SIZE_MAX},
+            {"quick_sort_extra",      [](vector<T> &v) { quick_sort_extra(v, L()); },                     false, SIZE_MAX},
+            {"quick_sort_inplace",    [](vector<T> &v) { quick_sort_inplace(v, L()); },                   false, SIZE_MAX},
+            {"parallel_sample_sort",  [](vector<T> &v) { parallel_sample_sort(v, L()); },                 false, SIZE_MAX},
+            {"indirect_sort",         [](vector<T> &v) { indirect_sort(v, L()); },                        false, SIZE_MAX},
+            {"network_sort",          [](vector<T> &v) { network_sort(v.data(), (int) v.size(), L()); }, false,
+                                                                                                                 NETWORK_SORT_MAX},
+            {"adaptive_sort",         [](vector<T> &v) { ::sort(v, L()); },                               false, SIZE_MAX},
+    };
+    add_radix_sorts(list, std::integral_constant<bool, !std::is_same<T, string>::value>());
+    add_string_sorts(list);
+    return list;
+}
+
+bool selected(const vector<string> &filter, const string &name) {
+    return filter.empty() || find(filter.begin(), filter.end(), name) != filter.end();
+}
+
+// EFFECTS: time alg on copies of input; after an untimed warm-up sort that sizes the batch, repeat
+//          batches are timed and the median and the fastest batch are reported. Every output has to
+//          equal expected, input sorted by std::sort, so a sort that loses or duplicates elements fails
+//          as well as one that leaves them out of order
+template<typename T>
+benchResult run_one(const algorithm<T> &alg, const vector<T> &input, const vector<T> &expected,
+                    const benchOptions &options) {
+    size_t n = input.size();
+    size_t bytes = 0;
+    for (const T &value : input) bytes += element_bytes(value);
+    vector<T> warmUp(input);
+    auto start = chrono::steady_clock::now();
+    alg.run(warmUp);
+    double once = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    bool ok = warmUp == expected;
+    warmUp = vector<T>();
+    size_t batch = max<size_t>(BATCH_ELEMENTS / max<size_t>(n, 1), 1);
+    if (once > 0) batch = max<size_t>(min(batch, (size_t) (BATCH_SECONDS / once) + 1), 1);
+    vector<double> seconds;
+    for (int r = 0; r < options.repeat; r++) {
+        vector<vector<T>> copies(batch, input);
+        start = chrono::steady_clock::now();
+        for (vector<T> &copy : copies) alg.run(copy);
+        seconds.push_back(chrono::duration<double>(chrono::steady_clock::now() - start).count());
+        for (const vector<T> &copy : copies) ok = ok && copy == expected;
+    }
+    std::sort(seconds.begin(), seconds.end());
+    double median = seconds[seconds.size() / 2];
+    double elements = (double) n * (double) batch;
+    benchResult result;
+    result.algorithm = alg.name;
+    result.size = n;
+    result.runs = options.repeat;
+    result.nsPerElement = elements > 0 ? median * 1e9 / elements : 0;
+    result.minNsPerElement = elements > 0 ? seconds.front() * 1e9 / elements : 0;
+    result.bytesPerSecond = median > 0 ? (double) bytes * (double) batch / median : 0;
+    result.ok = ok;
+    return result;
+}
+
+void print_header(const benchOptions &options) {
+    if (!options.json) {
+        cout << "type,distribution,size,algorithm,runs,ns_per_element,min_ns_per_element,bytes_per_second,ok\n";
+        return;
+    }
+    cout << "{\"meta\": {\"compiler\": \"" <<
+         #if defined(__clang__)
+         "clang " << __clang_major__ << "." << __clang_minor__
+         #elif defined(__GNUC__)
+         "gcc " << __GNUC__ << "." << __GNUC_MINOR__
+         #else
+         "unknown"
+         #endif
+         << "\", \"optimized\": " <<
+         #ifdef __OPTIMIZE__
+         "true"
+         #else
+         "false"
+         #endif
+         << ", \"threads\": " << thread::hardware_concurrency() << ", \"seed\": " << options.seed
+         << ", \"repeat\": " << options.repeat << "},\n \"results\": [";
+}
+
+// EFFECTS: value as the contents of a JSON string, with quotes, backslashes and control characters escaped
+string json_escape(const string &value) {
+    string escaped;
+    for (char c : value) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+            escaped += c;
+        } else if ((unsigned char) c < 0x20) {
+            char code[8];
+            snprintf(code, sizeof(code), "\\u%04x", (unsigned) c);
+            escaped += code;
+        } else {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+void print_result(const benchResult &result, const benchOptions &options, bool first) {
+    char line[512];
+    if (options.json) {
+        snprintf(line, sizeof(line), "%s\n  {\"type\": \"%s\", \"distribution\": \"%s\", \"size\": %zu, "
+                                     "\"algorithm\": \"%s\", \"runs\": %d, \"ns_per_element\": %.4f, "
+                                     "\"min_ns_per_element\": %.4f, \"bytes_per_second\": %.6g, \"ok\": %s}",
+                 first ? "" : ",", json_escape(result.type).c_str(), json_escape(result.distribution).c_str(),
+                 result.size, json_escape(result.algorithm).c_str(), result.runs, result.nsPerElement, result.minNsPerElement,
+                 result.bytesPerSecond, result.ok ? "true" : "false");
+    } else {
+        snprintf(line, sizeof(line), "%s,%s,%zu,%s,%d,%.4f,%.4f,%.6g,%d\n", result.type.c_str(),
+                 result.distribution.c_str(), result.size, result.algorithm.c_str(), result.runs, result.nsPerElement,
+                 result.minNsPerElement, result.bytesPerSecond, result.ok ? 1 : 0);
+    }
+    cout << line << flush;
+}
+
+// EFFECTS: benchmark every selected algorithm on T, returns the number of wrong outputs
+template<typename T>
+int bench_type(const string &typeName, const benchOptions &options, bool &first) {
+    if (!selected(options.types, typeName)) return 0;
+    int failures = 0;
+    vector<algorithm<T>> list = algorithms_for<T>();
+    for (const char *distribution : DISTRIBUTIONS) {
+        if (!selected(options.distributions, distribution)) continue;
+        for (size_t n : options.sizes) {
+            // input, the expected output, the copy being sorted and a scratch buffer
+            if (n * sizeof(T) * 4 > options.maxBytes) {
+                cerr << "skipping " << typeName << " n=" << n << ": over --max-bytes\n";
+                continue;
+            }
+            vector<uint64_t> keys = make_keys(distribution, n, options.seed);
+            vector<T> input(n);
+            for (size_t i = 0; i < n; i++) convert(keys[i], input[i]);
+            keys = vector<uint64_t>();
+            vector<T> expected(input);
+            std::sort(expected.begin(), expected.end());
+            for (const algorithm<T> &alg : list) {
+                if (!selected(options.algorithms, alg.name) || n > alg.maxSize) continue;
+                if (alg.quadratic && n > options.quadraticMax) continue;
+                benchResult result = run_one(alg, input, expected, options);
+                result.type = typeName;
+                result.distribution = distribution;
+                print_result(result, options, first);
+                first = false;
+                if (!result.ok) {
+                    cerr << "FAILED: " << alg.name << " on " << typeName << " " << distribution << " n=" << n << "\n";
+                    failures++;
+                }
+            }
+        }
+    }
+    return failures;
+}
+
+vector<string> split(const string &list) {
+    vector<string> items;
+    stringstream stream(list);
+    string item;
+    while (getline(stream, item, ',')) if (!item.empty()) items.push_back(item);
+    return items;
+}
+
+void usage() {
+    cerr << "usage: sort_bench [options]\n"
+            "  --sizes N,N,...        sizes to run (default: 16, 256, 4096, 65536, 2^20, 2^24, 1e8 up to --max-size)\n"
+            "  --max-size N           largest default size (default 1048576)\n"
+            "  --types LIST           int32,int64,double,string,record64 (default: all)\n"
+            "  --distributions LIST   random,sorted,reversed,organ_pipe,few_unique,nearly_sorted,zipf (default: all)\n"
+            "  --algorithms LIST      algorithm names as printed (default: all)\n"
+            "  --quadratic-max N      largest size for bubble / insertion / selection sort (default 4096)\n"
+            "  --max-bytes N          skip sizes whose buffers would exceed N bytes (default 2 GiB)\n"
+            "  --repeat N             timed batches per row, the median is reported (default 5)\n"
+            "  --seed N               seed of the inputs (default 281)\n"
+            "  --format csv|json      output format (default csv)\n";
+}
+
+int main(int argc, char *argv[]) {
+    benchOptions options;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--help" || arg == "-h") {
+            usage();
+            return 0;
+        }
+        if (i + 1 >= argc) {
+            usage();
+            return 2;
+        }
+        string value = argv[++i];
+        if (arg == "--sizes") {
+            for (const string &size : split(value)) options.sizes.push_back((size_t) stod(size));
+        } else if (arg == "--max-size") options.maxSize = (size_t) stod(value);
+        else if (arg == "--types") options.types = split(value);
+        else if (arg == "--distributions") options.distributions = split(value);
+        else if (arg == "--algorithms") options.algorithms = split(value);
+        else if (arg == "--quadratic-max") options.quadraticMax = (size_t) stod(value);
+        else if (arg == "--max-bytes") options.maxBytes = (size_t) stod(value);
+        else if (arg == "--repeat") options.repeat = max(stoi(value), 1);
+        else if (arg == "--seed") options.seed = stoull(value);
+        else if (arg == "--format" && (value == "csv" || value == "json")) options.json = value == "json";
+        else {
+            usage();
+            return 2;
+        }
+    }
+    if (options.sizes.empty()) {
+        for (size_t size : SIZE_LADDER) if (size <= options.maxSize) options.sizes.push_back(size);
+    }
+    print_header(options);
+    bool first = true;
+    int failures = 0;
+    failures += bench_type<int32_t>("int32", options, first);
+    failures += bench_type<int64_t>("int64", options, first);
+    failures += bench_type<double>("double", options, first);
+    failures += bench_type<string>("string", options, first);
+    failures += bench_type<record>("record64", options, first);
+    if (options.json) cout << "\n]}\n";
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,440 @@
+#ifndef VE281P1_SORT_NETWORK_HPP
+#define VE281P1_SORT_NETWORK_HPP
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <type_traits>
+#include <utility>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define VE281P1_SORT_NETWORK_X86 1
+#include <immintrin.h>
+#endif
+
+// largest block sorted by simd_network_sort
+const int SIMD_NETWORK_MAX = 64;
+
+namespace SortNetwork {
+    // EFFECTS: lane type of the network for T: int32_t / int64_t for signed integers, float / double
+    template<typename T, bool Integral = std::is_integral<T>::value>
+    struct lane {
+        typedef typename std::conditional<std::is_same<T, float>::value || std::is_same<T, double>::value,
+                T, void>::type type;
+    };
+
+    template<typename T>
+    struct lane<T, true> {
+        typedef typename std::conditional<!std::is_signed<T>::value || std::is_same<T, bool>::value, void,
+                typename std::conditional<sizeof(T) == 4, int32_t,
+                        typename std::conditional<sizeof(T) == 8, int64_t, void>::type>::type>::type type;
+    };
+
+    template<typename Lane>
+    Lane lane_max() {
+        return std::numeric_limits<Lane>::has_infinity ? std::numeric_limits<Lane>::infinity()
+                                                       : std::numeric_limits<Lane>::max();
+    }
+
+#ifdef VE281P1_SORT_NETWORK_X86
+    // 0: scalar only, 1: SSE4.2, 2: AVX2
+    inline int simd_level() {
+        static const int level = [] {
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx2")) return 2;
+            if (__builtin_cpu_supports("sse4.2")) return 1;
+            return 0;
+        }();
+        return level;
+    }
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+    namespace Avx2 {
+        struct Base {
+            typedef __m256i Reg;
+
+            // permute and masks work on 32-bit units, SCALE of them per lane
+            static Reg permute(Reg v, int m) {
+                return _mm256_permutevar8x32_epi32(
+                        v, _mm256_xor_si256(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(m)));
+            }
+
+            static Reg lowMask(int j) {
+                return _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+                                                           _mm256_set1_epi32(j)), _mm256_setzero_si256());
+            }
+
+            static Reg blend(Reg a, Reg b, Reg mask) { return _mm256_blendv_epi8(a, b, mask); }
+        };
+
+        template<typename Lane>
+        struct Ops : Base {
+            static const int WIDTH = 32 / sizeof(Lane);
+            static const int SCALE = sizeof(Lane) / 4;
+
+            static Reg load(const void *p) { return _mm256_loadu_si256(static_cast<const Reg *>(p)); }
+
+            static void store(void *p, Reg v) { _mm256_storeu_si256(static_cast<Reg *>(p), v); }
+
+            static Reg lt(Reg a, Reg b);
+        };
+
+        template<>
+        inline __m256i Ops<int32_t>::lt(__m256i a, __m256i b) { return _mm256_cmpgt_epi32(b, a); }
+
+        template<>
+        inline __m256i Ops<int64_t>::lt(__m256i a, __m256i b) { return _mm256_cmpgt_epi64(b, a); }
+
+        template<>
+        inline __m256i Ops<float>::lt(__m256i a, __m256i b) {
+            return _mm256_castps_si256(_mm256_cmp_ps(_mm256_castsi256_ps(a), _mm256_castsi256_ps(b), _CMP_LT_OQ));
+        }
+
+        template<>
+        inline __m256i Ops<double>::lt(__m256i a, __m256i b) {
+            return _mm256_castpd_si256(_mm256_cmp_pd(_mm256_castsi256_pd(a), _mm256_castsi256_pd(b), _CMP_LT_OQ));
+        }
+
+#include "sort_network_kernel.hpp"
+    }
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("sse4.2")
+    namespace Sse {
+        struct Base {
+            typedef __m128i Reg;
+
+            // permute and masks work on bytes, SCALE of them per lane
+            static Reg permute(Reg v, int m) {
+                return _mm_shuffle_epi8(v, _mm_xor_si128(_mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15),
+                                                         _mm_set1_epi8((char) m)));
+            }
+
+            static Reg lowMask(int j) {
+                return _mm_cmpeq_epi8(_mm_and_si128(_mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15),
+                                                    _mm_set1_epi8((char) j)), _mm_setzero_si128());
+            }
+
+            static Reg blend(Reg a, Reg b, Reg mask) { return _mm_blendv_epi8(a, b, mask); }
+        };
+
+        template<typename Lane>
+        struct Ops : Base {
+            static const int WIDTH = 16 / sizeof(Lane);
+            static const int SCALE = sizeof(Lane);
+
+            static Reg load(const void *p) { return _mm_loadu_si128(static_cast<const Reg *>(p)); }
+
+            static void store(void *p, Reg v) { _mm_storeu_si128(static_cast<Reg *>(p), v); }
+
+            static Reg lt(Reg a, Reg b);
+        };
+
+        template<>
+        inline __m128i Ops<int32_t>::lt(__m128i a, __m128i b) { return _mm_cmplt_epi32(a, b); }
+
+        template<>
+        inline __m128i Ops<int64_t>::lt(__m128i a, __m128i b) { return _mm_cmpgt_epi64(b, a); }
+
+        template<>
+        inline __m128i Ops<float>::lt(__m128i a, __m128i b) {
+            return _mm_castps_si128(_mm_cmplt_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b)));
+        }
+
+        template<>
+        inline __m128i Ops<double>::lt(__m128i a, __m128i b) {
+            return _mm_castpd_si128(_mm_cmplt_pd(_mm_castsi128_pd(a), _mm_castsi128_pd(b)));
+        }
+
+#include "sort_network_kernel.hpp"
+    }
+#pragma GCC pop_options
+#endif
+
+    template<typename T, typename Compare>
+    struct is_less : std::integral_constant<bool,
+            std::is_same<Compare, std::less<T>>::value || std::is_same<Compare, std::less<>>::value> {
+    };
+
+    template<typename T, typename Compare>
+    struct is_greater : std::integral_constant<bool,
+            std::is_same<Compare, std::greater<T>>::value || std::is_same<Compare, std::greater<>>::value> {
+    };
+}
+
+// EFFECTS: whether simd_network_sort handles T with comp: signed 32 / 64-bit integers, float and
+//          double, compared with std::less or std::greater
+template<typename T, typename Compare>
+struct simd_network_sortable : std::integral_constant<bool,
+        !std::is_same<typename SortNetwork::lane<T>::type, void>::value &&
+        (SortNetwork::is_less<T, Compare>::value || SortNetwork::is_greater<T, Compare>::value)> {
+};
+
+template<typename T, typename Compare>
+bool simd_network_sort(T *, int, Compare, std::false_type) {
+    return false;
+}
+
+// EFFECTS: sort data[0..n - 1] with a bitonic sorting network held in AVX2 (or SSE4.2) registers,
+//          picked at run time; returns false without touching data when n > SIMD_NETWORK_MAX
+//          or the CPU has neither instruction set, then the caller sorts the block itself
+template<typename T, typename Compare>
+bool simd_network_sort(T *data, int n, Compare, std::true_type) {
+#ifdef VE281P1_SORT_NETWORK_X86
+    typedef typename SortNetwork::lane<T>::type Lane;
+    if (n > SIMD_NETWORK_MAX) return false;
+    int level = SortNetwork::simd_level();
+    if (level == 0) return false;
+    Lane lanes[SIMD_NETWORK_MAX];
+    std::memcpy(lanes, data, n * sizeof(T));
+    if (level == 2) SortNetwork::Avx2::network_sort(lanes, n);
+    else SortNetwork::Sse::network_sort(lanes, n);
+    std::memcpy(data, lanes, n * sizeof(T));
+    if (SortNetwork::is_greater<T, Compare>::value) std::reverse(data, data + n);
+    return true;
+#else
+    (void) data;
+    (void) n;
+    return false;
+#endif
+}
+
+template<typename T, typename Compare>
+bool simd_network_sort(T *data, int n, Compare comp) {
+    return simd_network_sort(data, n, comp, simd_network_sortable<T, Compare>());
+}
+
+// EFFECTS: whether simd_network_sort can stand in for a stable sort of T: integers which compare
+//          equal are identical, while -0.0 and +0.0 compare equal and may be swapped by the network
+template<typename T, typename Compare>
+struct simd_network_stable : std::integral_constant<bool,
+        simd_network_sortable<T, Compare>::value && std::is_integral<T>::value> {
+};
+
+// EFFECTS: simd_network_sort for the leaves of the stable sorts, false for floating point keys
+template<typename T, typename Compare>
+bool simd_network_stable_sort(T *data, int n, Compare comp) {
+    return simd_network_sort(data, n, comp, simd_network_stable<T, Compare>());
+}
+
+// EFFECTS: whether simd_merge handles T with comp: the integer lane types of simd_network_sort with
+//          std::less; the merge network does not keep equal keys in order, which is only invisible
+//          for integers, while -0.0 and +0.0 compare equal and could swap
+template<typename T, typename Compare>
+struct simd_mergeable : std::integral_constant<bool,
+        !std::is_same<typename SortNetwork::lane<T>::type, void>::value && std::is_integral<T>::value &&
+        SortNetwork::is_less<T, Compare>::value> {
+};
+
+template<typename T, typename Compare>
+T *simd_merge(const T *, const T *, const T *, const T *, T *, Compare, std::false_type) {
+    return nullptr;
+}
+
+// EFFECTS: merge the sorted runs [a, aEnd) and [b, bEnd) into out one register at a time with a
+//          bitonic merge network, the tail of less than a register is merged by scalar code;
+//          returns the end of the output, or nullptr without writing anything when the CPU has no
+//          SSE4.2 / AVX2 or a run is shorter than a register, then the caller merges itself
+template<typename T, typename Compare>
+T *simd_merge(const T *a, const T *aEnd, const T *b, const T *bEnd, T *out, Compare, std::true_type) {
+#ifdef VE281P1_SORT_NETWORK_X86
+    typedef typename SortNetwork::lane<T>::type Lane;
+    int level = SortNetwork::simd_level();
+    if (level == 0) return nullptr;
+    const int W = level == 2 ? (int) SortNetwork::Avx2::Ops<Lane>::WIDTH : (int) SortNetwork::Sse::Ops<Lane>::WIDTH;
+    if (aEnd - a < W || bEnd - b < W) return nullptr;
+    T pending[SIMD_NETWORK_MAX];
+    if (level == 2) out = SortNetwork::Avx2::merge_runs<Lane>(a, aEnd, b, bEnd, out, pending);
+    else out = SortNetwork::Sse::merge_runs<Lane>(a, aEnd, b, bEnd, out, pending);
+    // pending holds W sorted elements not yet written, and the run the loop stopped on has less
+    // than W left; merge those two first, then the result with the rest of the other run
+    T small[2 * SIMD_NETWORK_MAX];
+    const T *&shortRun = aEnd - a < W ? a : b;
+    const T *shortEnd = aEnd - a < W ? aEnd : bEnd;
+    T *smallEnd = small;
+    const T *p = pending;
+    while (p != pending + W && shortRun != shortEnd) {
+        if (*shortRun < *p) *smallEnd++ = *shortRun++;
+        else *smallEnd++ = *p++;
+    }
+    while (p != pending + W) *smallEnd++ = *p++;
+    while (shortRun != shortEnd) *smallEnd++ = *shortRun++;
+    const T *&longRun = aEnd - a < W ? b : a;
+    const T *longEnd = aEnd - a < W ? bEnd : aEnd;
+    const T *q = small;
+    while (q != smallEnd && longRun != longEnd) {
+        if (*longRun < *q) *out++ = *longRun++;
+        else *out++ = *q++;
+    }
+    while (q != smallEnd) *out++ = *q++;
+    while (longRun != longEnd) *out++ = *longRun++;
+    return out;
+#else
+    (void) a;
+    (void) aEnd;
+    (void) b;
+    (void) bEnd;
+    (void) out;
+    return nullptr;
+#endif
+}
+
+template<typename T, typename Compare>
+T *simd_merge(const T *a, const T *aEnd, const T *b, const T *bEnd, T *out, Compare comp) {
+    return simd_merge(a, aEnd, b, bEnd, out, comp, simd_mergeable<T, Compare>());
+}
+
+// largest N of the compile-time networks of network_sort
+const int NETWORK_SORT_MAX = 32;
+
+namespace SortNetwork {
+    // EFFECTS: hand every comparator (a, b), a < b, of Batcher's odd-even merge sort on n inputs to
+    //          sink.add in order. Comparators reaching past n are dropped, which is the network for the
+    //          next power of two with +infinity padding; optimal up to 8, at most 12% more comparators
+    //          than the best known networks up to 16 (63 instead of 60 for 16) and 191 for 32
+    template<typename Sink>
+    constexpr void odd_even_network(size_t n, Sink &sink) {
+        for (size_t p = 1; p < n; p += p) {
+            for (size_t k = p; k >= 1; k /= 2) {
+                for (size_t j = k % p; j + k < n; j += 2 * k) {
+                    for (size_t i = 0; i < k && i + j + k < n; i++) {
+                        if ((i + j) / (2 * p) == (i + j + k) / (2 * p)) sink.add(i + j, i + j + k);
+                    }
+                }
+            }
+        }
+    }
+
+    struct ComparatorCount {
+        size_t size = 0;
+
+        constexpr void add(size_t, size_t) { size++; }
+    };
+
+    constexpr size_t comparator_count(size_t n) {
+        ComparatorCount count;
+        odd_even_network(n, count);
+        return count.size;
+    }
+
+    template<size_t N>
+    struct ComparatorTable {
+        static constexpr size_t SIZE = comparator_count(N);
+        unsigned char first[SIZE ? SIZE : 1] = {};
+        unsigned char second[SIZE ? SIZE : 1] = {};
+        size_t size = 0;
+
+        constexpr void add(size_t a, size_t b) {
+            first[size] = (unsigned char) a;
+            second[size] = (unsigned char) b;
+            size++;
+        }
+    };
+
+    template<size_t N>
+    constexpr ComparatorTable<N> make_table() {
+        ComparatorTable<N> table;
+        odd_even_network(N, table);
+        return table;
+    }
+
+    template<size_t N>
+    struct Network {
+        static_assert(N <= NETWORK_SORT_MAX, "network_sort takes at most NETWORK_SORT_MAX elements");
+        static constexpr ComparatorTable<N> table = make_table<N>();
+    };
+
+    template<size_t N>
+    constexpr ComparatorTable<N> Network<N>::table;
+
+    // EFFECTS: order a and b: 1 is a select per side on one comparison for arithmetic types and
+    //          pointers, 0 a conditional swap by moves for everything else. Both sides take the same
+    //          comparison, so equivalent but distinguishable values (-0.0 and +0.0, NaNs) stay where
+    //          they are and are never duplicated, as in the SIMD kernels
+    template<typename T, typename Compare>
+    struct exchange_kind : std::integral_constant<int, std::is_arithmetic<T>::value || std::is_pointer<T>::value ? 1 : 0> {
+    };
+
+    template<typename T, typename Compare>
+    constexpr void compare_exchange(T &a, T &b, Compare comp, std::integral_constant<int, 1>) {
+        bool swap = comp(b, a);
+        T lo = swap ? b : a;
+        T hi = swap ? a : b;
+        a = lo;
+        b = hi;
+    }
+
+    template<typename T, typename Compare>
+    constexpr void compare_exchange(T &a, T &b, Compare comp, std::integral_constant<int, 0>) {
+        if (comp(b, a)) {
+            T temp = std::move(a);
+            a = std::move(b);
+            b = std::move(temp);
+        }
+    }
+
+    // EFFECTS: every comparator of the table as straight-line code, the indices are constants
+    template<size_t N, typename T, typename Compare, size_t... I>
+    constexpr void apply_network(T *data, Compare comp, std::index_sequence<I...>) {
+        int expand[] = {0, (compare_exchange(data[Network<N>::table.first[I]], data[Network<N>::table.second[I]], comp,
+                                             exchange_kind<T, Compare>()), 0)...};
+        (void) expand;
+        (void) data;
+        (void) comp;
+    }
+
+    template<typename T, size_t N, typename Compare, size_t... I>
+    constexpr std::array<T, N> sorted_copy(const std::array<T, N> &data, Compare comp, std::index_sequence<I...>) {
+        T buffer[N ? N : 1] = {data[I]...};
+        apply_network<N>(buffer, comp, std::make_index_sequence<ComparatorTable<N>::SIZE>());
+        return std::array<T, N>{{buffer[I]...}};
+    }
+}
+
+// EFFECTS: sort data[0..N - 1] with the compile-time sorting network for N, see odd_even_network;
+//          no loop or branch is left for arithmetic types, and it can run in constant expressions
+template<size_t N, typename T, typename Compare = std::less<T>>
+constexpr void network_sort(T *data, Compare comp = Compare()) {
+    SortNetwork::apply_network<N>(data, comp, std::make_index_sequence<SortNetwork::ComparatorTable<N>::SIZE>());
+}
+
+template<typename T, size_t N, typename Compare = std::less<T>>
+constexpr void network_sort(T (&data)[N], Compare comp = Compare()) {
+    network_sort<N>(data, comp);
+}
+
+// EFFECTS: constexpr from C++17 on, where std::array::data() is; network_sorted works in C++14
+template<typename T, size_t N, typename Compare = std::less<T>>
+constexpr void network_sort(std::array<T, N> &data, Compare comp = Compare()) {
+    network_sort<N>(data.data(), comp);
+}
+
+// EFFECTS: a sorted copy of data, usable in C++14 constant expressions
+template<typename T, size_t N, typename Compare = std::less<T>>
+constexpr std::array<T, N> network_sorted(const std::array<T, N> &data, Compare comp = Compare()) {
+    return SortNetwork::sorted_copy(data, comp, std::make_index_sequence<N>());
+}
+
+template<typename T, typename Compare, size_t... N>
+bool network_sort(T *data, int n, Compare comp, std::index_sequence<N...>) {
+    typedef void (*Kernel)(T *, Compare);
+    static const Kernel kernels[] = {&network_sort<N, T, Compare>...};
+    if (n < 0 || n > NETWORK_SORT_MAX) return false;
+    kernels[n](data, comp);
+    return true;
+}
+
+// EFFECTS: sort data[0..n - 1] with the network for n when the size is only known at run time, for
+//          many tiny groups; returns false without touching data when n > NETWORK_SORT_MAX
+template<typename T, typename Compare>
+bool network_sort(T *data, int n, Compare comp) {
+    return network_sort(data, n, comp, std::make_index_sequence<NETWORK_SORT_MAX + 1>());
+}
+
+#endif //VE281P1_SORT_NETWORK_HPP
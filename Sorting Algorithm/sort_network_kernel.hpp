@@ -0,0 +1,126 @@
+// Register sorting network shared by the instruction sets of sort_network.hpp
+// ! NO INCLUDE GUARD: included once per instruction set, inside its namespace and target pragma !
+// Needs an Ops<Lane> in the enclosing namespace with
+//   Reg, WIDTH (lanes per register), SCALE (32-bit / byte units per lane for permute and mask),
+//   load, store (unaligned), lt (lane mask of a < b), permute (lane i <- lane i ^ m), lowMask (lanes with bit j clear)
+//   and blend (lanes of b where mask is set, else a)
+
+// EFFECTS: compare-exchange lane i with lane i ^ m, the lane with bit j clear keeps the smaller one;
+//          a lane is only replaced by a strictly smaller / greater partner, so equivalent but
+//          distinguishable values (-0.0 and +0.0) are never duplicated
+template<typename Lane>
+inline typename Ops<Lane>::Reg exchange(typename Ops<Lane>::Reg v, int m, int j) {
+    typedef Ops<Lane> O;
+    typename O::Reg p = O::permute(v, m * O::SCALE);
+    typename O::Reg swap = O::blend(O::lt(v, p), O::lt(p, v), O::lowMask(j * O::SCALE));
+    return O::blend(v, p, swap);
+}
+
+// EFFECTS: lane-wise compare-exchange of two registers, a keeps the smaller lanes
+template<typename Lane>
+inline void exchange(typename Ops<Lane>::Reg &a, typename Ops<Lane>::Reg &b) {
+    typedef Ops<Lane> O;
+    typename O::Reg swap = O::lt(b, a);
+    typename O::Reg lo = O::blend(a, b, swap);
+    b = O::blend(b, a, swap);
+    a = lo;
+}
+
+// EFFECTS: bitonic sort of count registers (count a power of two) in the "flip" form:
+//          every merge first compares element i with its mirror, then half-cleans with
+//          strides that halve down to one, so all comparators go in the same direction
+template<typename Lane>
+inline void sort_registers(typename Ops<Lane>::Reg *regs, int count) {
+    typedef Ops<Lane> O;
+    const int W = O::WIDTH;
+    for (int r = 0; r < count; r++) {
+        typename O::Reg v = regs[r];
+        for (int k = 2; k <= W; k <<= 1) {
+            v = exchange<Lane>(v, k - 1, k / 2);
+            for (int j = k / 4; j > 0; j >>= 1) v = exchange<Lane>(v, j, j);
+        }
+        regs[r] = v;
+    }
+    for (int run = 1; run < count; run <<= 1) {
+        for (int base = 0; base < count; base += 2 * run) {
+            for (int a = 0; a < run; a++) {
+                typename O::Reg mirror = O::permute(regs[base + 2 * run - 1 - a], (W - 1) * O::SCALE);
+                exchange<Lane>(regs[base + a], mirror);
+                regs[base + 2 * run - 1 - a] = O::permute(mirror, (W - 1) * O::SCALE);
+            }
+            for (int stride = run / 2; stride > 0; stride >>= 1) {
+                for (int a = base; a < base + 2 * run; a++) {
+                    if ((a - base) & stride) continue;
+                    exchange<Lane>(regs[a], regs[a + stride]);
+                }
+            }
+            for (int a = base; a < base + 2 * run; a++) {
+                typename O::Reg v = regs[a];
+                for (int j = W / 2; j > 0; j >>= 1) v = exchange<Lane>(v, j, j);
+                regs[a] = v;
+            }
+        }
+    }
+}
+
+// EFFECTS: sort data[0..n - 1] (n <= SIMD_NETWORK_MAX), padded with the greatest lane value
+//          up to a power of two number of registers
+template<typename Lane>
+inline void network_sort(Lane *data, int n) {
+    typedef Ops<Lane> O;
+    const int W = O::WIDTH;
+    int count = 1;
+    while (count * W < n) count <<= 1;
+    alignas(64) Lane buffer[SIMD_NETWORK_MAX];
+    for (int i = 0; i < n; i++) buffer[i] = data[i];
+    for (int i = n; i < count * W; i++) buffer[i] = lane_max<Lane>();
+    typename O::Reg regs[SIMD_NETWORK_MAX];
+    for (int r = 0; r < count; r++) regs[r] = O::load(buffer + r * W);
+    sort_registers<Lane>(regs, count);
+    for (int r = 0; r < count; r++) O::store(buffer + r * W, regs[r]);
+    for (int i = 0; i < n; i++) data[i] = buffer[i];
+}
+
+// EFFECTS: bitonic merge of two sorted registers, a gets the lower half and b the upper half
+template<typename Lane>
+inline void merge_registers(typename Ops<Lane>::Reg &a, typename Ops<Lane>::Reg &b) {
+    typedef Ops<Lane> O;
+    const int W = O::WIDTH;
+    typename O::Reg mirror = O::permute(b, (W - 1) * O::SCALE);
+    exchange<Lane>(a, mirror);
+    b = O::permute(mirror, (W - 1) * O::SCALE);
+    for (int j = W / 2; j > 0; j >>= 1) {
+        a = exchange<Lane>(a, j, j);
+        b = exchange<Lane>(b, j, j);
+    }
+}
+
+// EFFECTS: merge two sorted runs of at least WIDTH elements into out, each step loads a register
+//          from the run with the smaller head and writes the lower half of its merge with the
+//          register kept from the step before; stops when that run has less than WIDTH left.
+//          Advances a and b, stores the kept register (the WIDTH largest elements read so far,
+//          sorted) into pending and returns the end of the output
+template<typename Lane, typename T>
+inline T *merge_runs(const T *&a, const T *aEnd, const T *&b, const T *bEnd, T *out, T *pending) {
+    typedef Ops<Lane> O;
+    const int W = O::WIDTH;
+    typename O::Reg low = O::load(a);
+    typename O::Reg high = O::load(b);
+    a += W;
+    b += W;
+    merge_registers<Lane>(low, high);
+    O::store(out, low);
+    out += W;
+    while (true) {
+        bool takeB = a == aEnd || (b != bEnd && *b < *a);
+        const T *&run = takeB ? b : a;
+        if ((takeB ? bEnd : aEnd) - run < W) break;
+        low = O::load(run);
+        run += W;
+        merge_registers<Lane>(low, high);
+        O::store(out, low);
+        out += W;
+    }
+    O::store(pending, high);
+    return out;
+}
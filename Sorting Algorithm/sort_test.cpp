@@ -0,0 +1,678 @@
+// checks of the sorts in sort.hpp against the standard library, run by ctest
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <vector>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include "external_sort.hpp"
+#include "sort.hpp"
+
+static int failures = 0;
+
+#define CHECK(condition) do { \
+    if (!(condition)) { \
+        std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #condition << std::endl; \
+        failures++; \
+    } \
+} while (0)
+
+// EFFECTS: whether vector is a sorted permutation of expected, i.e. equal to it after sorting
+template<typename T>
+static bool sorted_like(const std::vector<T> &vector, std::vector<T> expected) {
+    std::sort(expected.begin(), expected.end());
+    return vector == expected;
+}
+
+// EFFECTS: 0, 1, ..., n / 2, ..., 1, 0
+template<typename T>
+static std::vector<T> organ_pipe(size_t n) {
+    std::vector<T> vector(n);
+    for (size_t i = 0; i < n; i++) vector[i] = (T) (i < n / 2 ? i : n - 1 - i);
+    return vector;
+}
+
+// EFFECTS: n / period ascending runs 0, 1, ..., period - 1
+template<typename T>
+static std::vector<T> sawtooth(size_t n, size_t period) {
+    std::vector<T> vector(n);
+    for (size_t i = 0; i < n; i++) vector[i] = (T) (i % period);
+    return vector;
+}
+
+// a key with the position it had in the input, so that the order of equal keys shows whether a sort is stable
+template<typename Key>
+struct Tagged {
+    Key key;
+    int index;
+
+    bool operator==(const Tagged &other) const { return key == other.key && index == other.index; }
+};
+
+template<typename Key>
+struct TaggedLess {
+    bool operator()(const Tagged<Key> &a, const Tagged<Key> &b) const { return a.key < b.key; }
+};
+
+// EFFECTS: n tagged keys drawn by draw(random), indices 0, 1, ..., n - 1
+template<typename Key, typename Draw>
+static std::vector<Tagged<Key>> tagged(size_t n, Draw draw) {
+    std::vector<Tagged<Key>> vector(n);
+    std::mt19937 random(281);
+    for (size_t i = 0; i < n; i++) vector[i] = Tagged<Key>{draw(random), (int) i};
+    return vector;
+}
+
+// EFFECTS: whether vector is input after std::stable_sort by key
+template<typename Key>
+static bool stable_sorted_like(const std::vector<Tagged<Key>> &vector, std::vector<Tagged<Key>> input) {
+    std::stable_sort(input.begin(), input.end(), TaggedLess<Key>());
+    return vector == input;
+}
+
+// radix_sort keeps equal keys in input order, both for a key read from the element and for a
+// computed key, and -0.0 does not sort before +0.0 since the two compare equal
+static void test_radix_sort_stable() {
+    std::vector<Tagged<int>> ints = tagged<int>(100000, [](std::mt19937 &random) { return (int) (random() % 1000) - 500; });
+    std::vector<Tagged<int>> vector = ints;
+    radix_sort(vector, [](const Tagged<int> &value) -> const int & { return value.key; });
+    CHECK(stable_sorted_like(vector, ints));
+    vector = ints;
+    radix_sort(vector, [](const Tagged<int> &value) { return value.key; });
+    CHECK(stable_sorted_like(vector, ints));
+    std::vector<Tagged<int64_t>> wide = tagged<int64_t>(100000, [](std::mt19937 &random) {
+        return (int64_t) ((uint64_t) random() << 32 | random()) >> (random() % 64);
+    });
+    std::vector<Tagged<int64_t>> wideSorted = wide;
+    radix_sort(wideSorted, [](const Tagged<int64_t> &value) { return value.key; });
+    CHECK(stable_sorted_like(wideSorted, wide));
+    const double zeros[] = {-0.0, 0.0, -1.5, 1.5, 2.0};
+    std::vector<Tagged<double>> doubles = tagged<double>(10000, [&](std::mt19937 &random) { return zeros[random() % 5]; });
+    std::vector<Tagged<double>> doublesSorted = doubles;
+    radix_sort(doublesSorted, [](const Tagged<double> &value) -> const double & { return value.key; });
+    CHECK(stable_sorted_like(doublesSorted, doubles));
+}
+
+// msd_radix_sort orders tuple keys lexicographically like operator<, with signed and floating point
+// components and keys which share long prefixes
+static void test_msd_radix_sort_tuples() {
+    typedef std::tuple<int, double, uint8_t> Key;
+    std::vector<Key> tuples(50000);
+    std::mt19937 random(281);
+    for (Key &key : tuples) {
+        key = Key((int) (random() % 7) - 3, (double) ((int) (random() % 9) - 4) / 2, (uint8_t) random());
+    }
+    std::vector<Key> vector = tuples;
+    msd_radix_sort(vector);
+    std::sort(tuples.begin(), tuples.end());
+    CHECK(vector == tuples);
+    std::vector<int64_t> ints(50000);
+    for (int64_t &key : ints) key = (int64_t) ((uint64_t) random() << 32 | random()) >> (random() % 64);
+    std::vector<int64_t> sorted = ints;
+    msd_radix_sort(sorted);
+    std::sort(ints.begin(), ints.end());
+    CHECK(sorted == ints);
+}
+
+// multikey_quick_sort orders strings like std::sort and its LCP array matches the common prefixes
+// of neighbours, on strings with long shared prefixes, duplicates, empty strings and '\0' characters
+static void test_multikey_quick_sort_lcp() {
+    std::vector<std::string> strings(20000);
+    std::mt19937 random(281);
+    for (std::string &string : strings) {
+        string = std::string(random() % 20, 'a');
+        size_t tail = random() % 6;
+        for (size_t i = 0; i < tail; i++) string += "ab\0c"[random() % 4];
+    }
+    std::vector<std::string> vector = strings;
+    std::vector<size_t> lcp;
+    multikey_quick_sort(vector, lcp);
+    std::sort(strings.begin(), strings.end());
+    CHECK(vector == strings);
+    bool prefixes = lcp.size() == strings.size() && lcp[0] == 0;
+    for (size_t i = 1; prefixes && i < strings.size(); i++) {
+        size_t common = 0;
+        while (common < strings[i - 1].size() && common < strings[i].size() &&
+               strings[i - 1][common] == strings[i][common]) {
+            common++;
+        }
+        prefixes = lcp[i] == common;
+    }
+    CHECK(prefixes);
+}
+
+// EFFECTS: whether vector is input after std::stable_sort, telling -0.0 from +0.0
+static bool stable_sorted_like(const std::vector<double> &vector, std::vector<double> input) {
+    std::stable_sort(input.begin(), input.end());
+    for (size_t i = 0; i < input.size(); i++) {
+        if (vector[i] != input[i] || std::signbit(vector[i]) != std::signbit(input[i])) return false;
+    }
+    return vector.size() == input.size();
+}
+
+// merge_sort is stable on doubles, where the SIMD network leaf would reorder -0.0 and +0.0
+static void test_merge_sort_signed_zero() {
+    std::vector<double> doubles(5000);
+    std::mt19937 random(281);
+    for (double &value : doubles) value = random() % 2 ? -0.0 : (random() % 3 ? 0.0 : 1.0);
+    std::vector<double> vector = doubles;
+    merge_sort(vector, std::less<double>());
+    CHECK(stable_sorted_like(vector, doubles));
+}
+
+// merge_sort_bottom_up keeps equal keys in input order, with its own scratch buffer and with one
+// reused by the caller, also on an odd number of passes and on doubles with signed zeros
+static void test_merge_sort_bottom_up_stable() {
+    std::vector<Tagged<int>> scratch;
+    const size_t sizes[] = {1000, 5000, 100000};
+    for (size_t n : sizes) {
+        std::vector<Tagged<int>> input = tagged<int>(n, [](std::mt19937 &random) { return (int) (random() % 100); });
+        std::vector<Tagged<int>> vector = input;
+        merge_sort_bottom_up(vector, TaggedLess<int>());
+        CHECK(stable_sorted_like(vector, input));
+        vector = input;
+        merge_sort_bottom_up(vector, scratch, TaggedLess<int>());
+        CHECK(stable_sorted_like(vector, input));
+    }
+    std::vector<double> doubles(5000);
+    std::mt19937 random(281);
+    for (double &value : doubles) value = random() % 2 ? -0.0 : (random() % 3 ? 0.0 : 1.0);
+    std::vector<double> vector = doubles;
+    merge_sort_bottom_up(vector, std::less<double>());
+    CHECK(stable_sorted_like(vector, doubles));
+}
+
+// tim_sort keeps equal keys in input order on random keys and on ascending and descending runs,
+// whose merges gallop
+static void test_tim_sort_stable() {
+    std::vector<Tagged<int>> random = tagged<int>(100000, [](std::mt19937 &random) { return (int) (random() % 1000); });
+    std::vector<Tagged<int>> runs = random;
+    for (size_t lo = 0; lo < runs.size(); lo += 5000) {
+        auto hi = runs.begin() + std::min(lo + 5000, runs.size());
+        std::stable_sort(runs.begin() + lo, hi, TaggedLess<int>());
+        if (lo / 5000 % 3 == 1) std::reverse(runs.begin() + lo, hi);
+    }
+    for (const std::vector<Tagged<int>> &input : {random, runs}) {
+        std::vector<Tagged<int>> vector = input;
+        tim_sort(vector, TaggedLess<int>());
+        CHECK(stable_sorted_like(vector, input));
+    }
+}
+
+// parallel_sample_sort sorts like std::sort, also when repeated splitters make it use equality
+// buckets: few distinct keys, one key filling half of the input, and a single key
+static void test_parallel_sample_sort() {
+    WorkStealingPool pool(4);
+    const size_t n = 300000;
+    std::mt19937 random(281);
+    for (int distribution = 0; distribution < 4; distribution++) {
+        std::vector<int64_t> input(n);
+        for (int64_t &key : input) {
+            if (distribution == 0) key = (int64_t) ((uint64_t) random() << 32 | random());
+            else if (distribution == 1) key = random() % 16;
+            else if (distribution == 2) key = random() % 2 ? 42 : (int64_t) random();
+            else key = 7;
+        }
+        std::vector<int64_t> vector = input;
+        parallel_sample_sort(vector, std::less<int64_t>(), pool);
+        std::sort(input.begin(), input.end());
+        CHECK(vector == input);
+    }
+}
+
+// organ pipes and sawtooth inputs made the median of three pick the worst pivot at every level,
+// so quick_sort_extra went quadratic and overflowed the stack from 65536 elements on
+static void test_quick_sort_extra_patterns() {
+    const size_t sizes[] = {100, 1000, 65536, 300000};
+    for (size_t n : sizes) {
+        std::vector<int> inputs[] = {organ_pipe<int>(n), sawtooth<int>(n, 1000), sawtooth<int>(n, n / 4 + 1)};
+        for (const std::vector<int> &input : inputs) {
+            std::vector<int> vector = input;
+            quick_sort_extra(vector, std::less<int>());
+            CHECK(sorted_like(vector, input));
+            vector = input;
+            quick_sort_extra(vector, std::greater<int>());
+            std::reverse(vector.begin(), vector.end());
+            CHECK(sorted_like(vector, input));
+        }
+        // reversed shorts wrap around, which gives a duplicate-heavy sawtooth
+        std::vector<short> shorts(n);
+        for (size_t i = 0; i < n; i++) shorts[i] = (short) (n - i);
+        std::vector<short> vector = shorts;
+        quick_sort_extra(vector, std::less<short>());
+        CHECK(sorted_like(vector, shorts));
+        vector = organ_pipe<short>(n);
+        quick_sort_extra(vector, std::less<short>());
+        CHECK(sorted_like(vector, organ_pipe<short>(n)));
+    }
+}
+
+struct ExternalRecord {
+    uint32_t key;
+    uint32_t index;
+
+    bool operator<(const ExternalRecord &other) const { return key < other.key; }
+};
+
+// small memory and blocks make phase one write 49 runs, more than the fan-in of 7, so there is an
+// intermediate merge pass before the one writing the output; output overwrites input
+static void test_external_sort() {
+    const std::string path = "sort_test_external.bin";
+    const size_t n = 200000;
+    std::vector<ExternalRecord> records(n);
+    std::mt19937 random(281);
+    for (size_t i = 0; i < n; i++) records[i] = ExternalRecord{(uint32_t) (random() % 50000), (uint32_t) i};
+    FILE *file = std::fopen(path.c_str(), "wb");
+    CHECK(file && std::fwrite(records.data(), sizeof(ExternalRecord), n, file) == n);
+    if (file) std::fclose(file);
+    ExternalSortOptions options;
+    options.memoryBytes = 64 << 10;
+    options.blockBytes = 4 << 10;
+    options.tempDirectory = ".";
+    external_sort<ExternalRecord>(path, path, std::less<ExternalRecord>(), options);
+    std::vector<ExternalRecord> sorted(n + 1);
+    file = std::fopen(path.c_str(), "rb");
+    CHECK(file && std::fread(sorted.data(), sizeof(ExternalRecord), n + 1, file) == n);
+    if (file) std::fclose(file);
+    std::remove(path.c_str());
+    sorted.resize(n);
+    std::vector<bool> seen(n, false);
+    bool ordered = true, permutation = true;
+    for (size_t i = 0; i < n; i++) {
+        if (i && sorted[i].key < sorted[i - 1].key) ordered = false;
+        uint32_t index = sorted[i].index;
+        if (index >= n || seen[index] || records[index].key != sorted[i].key) permutation = false;
+        else seen[index] = true;
+    }
+    CHECK(ordered);
+    CHECK(permutation);
+}
+
+// multiway_merge matches std::merge on two runs and a stable sort of the concatenation on many,
+// including empty runs; multiway_split at every rank takes exactly the merged prefix of that
+// length, and parallel_multiway_merge gives the same result as the serial merge
+static void test_multiway_merge() {
+    typedef std::vector<Tagged<int>>::const_iterator It;
+    std::vector<std::vector<Tagged<int>>> runs;
+    const size_t lengths[] = {30000, 0, 50000, 1, 20000, 0, 70000};
+    int index = 0;
+    for (size_t length : lengths) {
+        std::vector<Tagged<int>> run = tagged<int>(length, [](std::mt19937 &random) { return (int) (random() % 500); });
+        for (Tagged<int> &value : run) value.index = index++;
+        std::stable_sort(run.begin(), run.end(), TaggedLess<int>());
+        runs.push_back(run);
+    }
+    std::vector<std::pair<It, It>> ranges;
+    std::vector<Tagged<int>> concatenation;
+    for (const std::vector<Tagged<int>> &run : runs) {
+        ranges.emplace_back(run.begin(), run.end());
+        concatenation.insert(concatenation.end(), run.begin(), run.end());
+    }
+    std::vector<Tagged<int>> merged(concatenation.size()), expected(concatenation.size());
+    std::merge(runs[0].begin(), runs[0].end(), runs[2].begin(), runs[2].end(), expected.begin(), TaggedLess<int>());
+    std::vector<std::pair<It, It>> two = {ranges[0], ranges[2]};
+    multiway_merge(two, merged.begin(), TaggedLess<int>());
+    CHECK(std::equal(expected.begin(), expected.begin() + (runs[0].size() + runs[2].size()), merged.begin()));
+    multiway_merge(ranges, merged.begin(), TaggedLess<int>());
+    CHECK(stable_sorted_like(merged, concatenation));
+    std::vector<Tagged<int>> small(ranges.size() * 5);
+    std::vector<std::pair<It, It>> smallRanges;
+    for (const std::vector<Tagged<int>> &run : runs) {
+        smallRanges.emplace_back(run.begin(), run.begin() + std::min<size_t>(run.size(), 5));
+    }
+    ptrdiff_t total = multiway_merge(smallRanges, small.begin(), TaggedLess<int>()) - small.begin();
+    bool prefixes = true;
+    for (ptrdiff_t rank = 0; rank <= total; rank++) {
+        std::vector<ptrdiff_t> position;
+        multiway_split(smallRanges, rank, position, TaggedLess<int>());
+        std::vector<Tagged<int>> prefix;
+        for (size_t i = 0; i < smallRanges.size(); i++) {
+            prefix.insert(prefix.end(), smallRanges[i].first, smallRanges[i].first + position[i]);
+        }
+        std::stable_sort(prefix.begin(), prefix.end(), TaggedLess<int>());
+        prefixes = prefixes && (ptrdiff_t) prefix.size() == rank &&
+                   std::equal(prefix.begin(), prefix.end(), small.begin());
+    }
+    CHECK(prefixes);
+    WorkStealingPool pool(4);
+    std::vector<Tagged<int>> parallel(concatenation.size());
+    parallel_multiway_merge(ranges, parallel.begin(), TaggedLess<int>(), pool);
+    CHECK(parallel == merged);
+}
+
+// a key that can only be moved and has no default constructor, so a sort which copies an element or
+// creates one does not compile
+class MoveOnlyKey {
+public:
+    explicit MoveOnlyKey(int key) : key(new int(key)) {}
+
+    int value() const { return *key; }
+
+    bool operator<(const MoveOnlyKey &other) const { return *key < *other.key; }
+
+private:
+    std::unique_ptr<int> key;
+};
+
+// EFFECTS: whether vector holds the keys in ascending order
+static bool sorted_like(const std::vector<MoveOnlyKey> &vector, const std::vector<int> &keys) {
+    std::vector<int> values;
+    for (const MoveOnlyKey &key : vector) values.push_back(key.value());
+    return sorted_like(values, keys) && std::is_sorted(values.begin(), values.end());
+}
+
+// every sort on move-only keys, with scratch buffers it cannot default-construct
+static void test_sort_move_only() {
+    typedef std::vector<MoveOnlyKey> Keys;
+    const std::function<void(Keys &)> sorts[] = {
+            [](Keys &v) { bubble_sort(v, std::less<MoveOnlyKey>()); },
+            [](Keys &v) { insertion_sort(v, std::less<MoveOnlyKey>()); },
+            [](Keys &v) { selection_sort(v, std::less<MoveOnlyKey>()); },
+            [](Keys &v) { merge_sort(v, std::less<MoveOnlyKey>()); },
+            [](Keys &v) { quick_sort_extra(v, std::less<MoveOnlyKey>()); },
+            [](Keys &v) { quick_sort_inplace(v, std::less<MoveOnlyKey>()); },
+            [](Keys &v) { heap_sort(v, std::less<MoveOnlyKey>()); },
+            [](Keys &v) { merge_sort_bottom_up(v, std::less<MoveOnlyKey>()); },
+            [](Keys &v) { tim_sort(v, std::less<MoveOnlyKey>()); },
+            [](Keys &v) { radix_sort(v, [](const MoveOnlyKey &key) { return key.value(); }); },
+            [](Keys &v) { parallel_merge_sort(v, std::less<MoveOnlyKey>()); },
+            [](Keys &v) { parallel_sample_sort(v, std::less<MoveOnlyKey>()); },
+    };
+    for (size_t s = 0; s < sizeof(sorts) / sizeof(sorts[0]); s++) {
+        std::vector<int> keys = organ_pipe<int>(s < 3 ? 1000 : 100000);
+        Keys vector;
+        for (int key : keys) vector.emplace_back(key);
+        sorts[s](vector);
+        CHECK(sorted_like(vector, keys));
+    }
+}
+
+// argsort with MergeSorter gives the stable order, apply_permutation puts every element where the
+// permutation says and leaves the identity behind, and indirect_sort sorts move-only records
+static void test_argsort_permutation() {
+    std::vector<Tagged<int>> input = tagged<int>(100000, [](std::mt19937 &random) { return (int) (random() % 1000); });
+    std::vector<size_t> order = argsort(input, TaggedLess<int>(), MergeSorter());
+    std::vector<Tagged<int>> expected = input;
+    std::stable_sort(expected.begin(), expected.end(), TaggedLess<int>());
+    bool stable = order.size() == input.size();
+    for (size_t i = 0; stable && i < order.size(); i++) stable = input[order[i]] == expected[i];
+    CHECK(stable);
+    std::vector<Tagged<int>> vector = input;
+    apply_permutation(vector.begin(), vector.end(), order);
+    CHECK(vector == expected);
+    bool identity = true;
+    for (size_t i = 0; i < order.size(); i++) identity = identity && order[i] == i;
+    CHECK(identity);
+    std::vector<size_t> shuffle(input.size());
+    for (size_t i = 0; i < shuffle.size(); i++) shuffle[i] = i;
+    std::shuffle(shuffle.begin(), shuffle.end(), std::mt19937(281));
+    std::vector<size_t> permutation = shuffle;
+    vector = input;
+    apply_permutation(vector.begin(), vector.end(), permutation);
+    bool moved = true;
+    for (size_t i = 0; i < shuffle.size(); i++) moved = moved && vector[i] == input[shuffle[i]];
+    CHECK(moved);
+    bool thrown = false;
+    std::vector<size_t> tooShort(3);
+    try {
+        apply_permutation(vector.begin(), vector.end(), tooShort);
+    } catch (const std::invalid_argument &) {
+        thrown = true;
+    }
+    CHECK(thrown);
+    std::vector<int> keys = organ_pipe<int>(100000);
+    std::vector<MoveOnlyKey> records;
+    for (int key : keys) records.emplace_back(key);
+    indirect_sort(records, std::less<MoveOnlyKey>());
+    CHECK(sorted_like(records, keys));
+}
+
+// zip_sort keeps rows together and in input order on equal keys, through radix_sort for doubles
+// whose -0.0 and +0.0 compare equal and through quick_sort_inplace for another comparator; it
+// moves move-only payloads and rejects columns of different length
+static void test_zip_sort_stable() {
+    const double zeros[] = {-0.0, 0.0, -1.5, 1.5, 2.0};
+    std::vector<Tagged<double>> input = tagged<double>(50000, [&](std::mt19937 &random) {
+        return zeros[random() % 5];
+    });
+    std::vector<Tagged<double>> expected = input;
+    std::stable_sort(expected.begin(), expected.end(), TaggedLess<double>());
+    const int orders[] = {0, 1};
+    for (int order : orders) {
+        std::vector<double> keys;
+        std::vector<int> indices;
+        std::vector<MoveOnlyKey> owned;
+        for (const Tagged<double> &row : input) {
+            keys.push_back(row.key);
+            indices.push_back(row.index);
+            owned.emplace_back(row.index);
+        }
+        if (order == 0) zip_sort(keys, std::less<double>(), indices, owned);
+        else zip_sort(keys, std::greater<double>(), indices, owned);
+        bool stable = true;
+        for (size_t i = 0; i < input.size(); i++) {
+            stable = stable && std::signbit(keys[i]) == std::signbit(input[indices[i]].key) &&
+                     owned[i].value() == indices[i];
+            if (order == 0) stable = stable && indices[i] == expected[i].index;
+            else if (i > 0) {
+                stable = stable && keys[i] <= keys[i - 1] && (keys[i] < keys[i - 1] || indices[i - 1] < indices[i]);
+            }
+        }
+        CHECK(stable);
+    }
+    std::vector<int> keys(10), shorter(9);
+    bool thrown = false;
+    try {
+        zip_sort(keys, std::less<int>(), shorter);
+    } catch (const std::invalid_argument &) {
+        thrown = true;
+    }
+    CHECK(thrown);
+}
+
+// sort_by_key calls the projection once per element and is stable on every kernel of sort_rows:
+// radix_sort for a double key and msd_radix_sort for a tuple key, both with signed zeros which
+// compare equal, and quick_sort_inplace for another comparator
+static void test_sort_by_key_stable() {
+    const double zeros[] = {-0.0, 0.0, -1.5, 1.5, 2.0};
+    std::vector<Tagged<double>> input = tagged<double>(50000, [&](std::mt19937 &random) {
+        return zeros[random() % 5];
+    });
+    size_t calls = 0;
+    std::vector<Tagged<double>> vector = input;
+    sort_by_key(vector, [&](const Tagged<double> &value) {
+        calls++;
+        return value.key;
+    });
+    CHECK(calls == input.size());
+    CHECK(stable_sorted_like(vector, input));
+    vector = input;
+    sort_by_key(vector, [](const Tagged<double> &value) { return std::make_tuple((int) (value.key < 1), value.key); });
+    std::vector<Tagged<double>> expected = input;
+    std::stable_sort(expected.begin(), expected.end(), [](const Tagged<double> &a, const Tagged<double> &b) {
+        return std::make_tuple((int) (a.key < 1), a.key) < std::make_tuple((int) (b.key < 1), b.key);
+    });
+    CHECK(vector == expected);
+    vector = input;
+    sort_by_key(vector, [](const Tagged<double> &value) { return value.key; }, std::greater<double>());
+    expected = input;
+    std::stable_sort(expected.begin(), expected.end(), [](const Tagged<double> &a, const Tagged<double> &b) {
+        return a.key > b.key;
+    });
+    CHECK(vector == expected);
+}
+
+// select_nth puts the element std::nth_element would at nth with no greater one before and no smaller
+// one after it, partial_sort_prefix matches std::partial_sort, and TopK fed by several threads in
+// batches and single elements, and merged into another accumulator, keeps the k smallest
+static void test_select_nth_top_k() {
+    const size_t n = 200000;
+    std::mt19937 random(281);
+    std::vector<std::vector<int>> inputs = {organ_pipe<int>(n), sawtooth<int>(n, 7), std::vector<int>(n)};
+    for (int &key : inputs.back()) key = (int) random();
+    const size_t ranks[] = {0, 1, n / 3, n / 2, n - 1};
+    bool selected = true;
+    for (const std::vector<int> &input : inputs) {
+        for (size_t k : ranks) {
+            std::vector<int> vector = input, expected = input;
+            select_nth(vector, k, std::less<int>());
+            std::nth_element(expected.begin(), expected.begin() + k, expected.end());
+            std::vector<int> permutation = vector;
+            std::sort(permutation.begin(), permutation.end());
+            selected = selected && vector[k] == expected[k] && sorted_like(permutation, input) &&
+                       std::all_of(vector.begin(), vector.begin() + k, [&](int key) { return key <= vector[k]; }) &&
+                       std::all_of(vector.begin() + k, vector.end(), [&](int key) { return key >= vector[k]; });
+        }
+        std::vector<int> vector = input, expected = input;
+        partial_sort_prefix(vector, 1000, std::less<int>());
+        std::partial_sort(expected.begin(), expected.begin() + 1000, expected.end());
+        selected = selected && std::equal(vector.begin(), vector.begin() + 1000, expected.begin());
+    }
+    CHECK(selected);
+    const std::vector<int> &keys = inputs.back();
+    TopK<int> top(100), other(100);
+    {
+        WorkStealingPool pool(4);
+        TaskGroup group(pool);
+        for (size_t lo = 0; lo < n / 2; lo += 10000) {
+            group.run([&, lo] { top.push(keys.begin() + lo, keys.begin() + lo + 10000); });
+        }
+        for (size_t i = n / 2; i < n; i++) other.push(keys[i]);
+        group.wait();
+    }
+    top.merge(other);
+    std::vector<int> sorted = keys;
+    std::sort(sorted.begin(), sorted.end());
+    CHECK(top.result() == std::vector<int>(sorted.begin(), sorted.begin() + 100));
+    TopK<int> none(0);
+    none.push(keys.begin(), keys.end());
+    CHECK(none.size() == 0);
+}
+
+// every kernel the adaptive sort dispatches to on move-only keys, and sort() itself on sorted,
+// reversed, duplicate-heavy and random inputs and on unique_ptrs
+static void test_adaptive_sort() {
+    const SortKernel kernels[] = {SortKernel::Insertion, SortKernel::Tim, SortKernel::Indirect,
+                                  SortKernel::QuickInplace, SortKernel::QuickExtraParallel};
+    for (SortKernel kernel : kernels) {
+        std::vector<int> keys = organ_pipe<int>(kernel == SortKernel::Insertion ? 1000 : 100000);
+        std::vector<MoveOnlyKey> vector;
+        for (int key : keys) vector.emplace_back(key);
+        AdaptiveSort::run(kernel, vector, std::less<MoveOnlyKey>(), std::false_type());
+        CHECK(sorted_like(vector, keys));
+    }
+    std::vector<int> ascending = sawtooth<int>(100000, 100000), random(100000);
+    std::vector<int> descending(ascending.rbegin(), ascending.rend());
+    std::mt19937 draw(281);
+    for (int &key : random) key = (int) draw();
+    std::vector<int> inputs[] = {ascending, descending, sawtooth<int>(100000, 16), random, organ_pipe<int>(50)};
+    for (const std::vector<int> &input : inputs) {
+        std::vector<int> vector = input;
+        sort(vector);
+        CHECK(sorted_like(vector, input));
+        vector = input;
+        adaptive_sort(vector.begin(), vector.end());
+        CHECK(sorted_like(vector, input));
+    }
+    std::vector<std::unique_ptr<int>> pointers;
+    for (int i = 0; i < 100000; i++) pointers.emplace_back(new int(i * 7919 % 100003));
+    sort(pointers, [](const std::unique_ptr<int> &a, const std::unique_ptr<int> &b) { return *a < *b; });
+    bool ordered = true;
+    for (size_t i = 1; i < pointers.size(); i++) ordered = ordered && *pointers[i - 1] <= *pointers[i];
+    CHECK(ordered);
+}
+
+// the float compare-exchange of network_sort took min and max from two different comparisons, so
+// a -0.0 / +0.0 pair came out as two zeros of one sign and a NaN could replace its partner
+static void test_network_sort_signed_zero() {
+    for (int n = 2; n <= NETWORK_SORT_MAX; n++) {
+        std::vector<double> values(n);
+        for (int i = 0; i < n; i++) values[i] = i % 2 ? 0.0 : -0.0;
+        values[n / 2] = n % 3 ? std::nan("") : 1.0;
+        for (int greater = 0; greater < 2; greater++) {
+            std::vector<double> vector = values;
+            if (greater) network_sort(vector.data(), n, std::greater<double>());
+            else network_sort(vector.data(), n, std::less<double>());
+            int negative = 0, positive = 0, nans = 0;
+            for (double value : vector) {
+                if (std::isnan(value)) nans++;
+                else if (value == 0) (std::signbit(value) ? negative : positive)++;
+            }
+            CHECK(negative == (n + 1) / 2 - (n / 2 % 2 == 0));
+            CHECK(positive == n / 2 - (n / 2 % 2 == 1));
+            CHECK(nans == (n % 3 ? 1 : 0));
+        }
+    }
+}
+
+// network_sorted is a C++14 constant expression
+constexpr std::array<int, 6> networkSorted = network_sorted(std::array<int, 6>{{4, -1, 7, 0, -1, 3}});
+static_assert(networkSorted[0] == -1 && networkSorted[1] == -1 && networkSorted[2] == 0 &&
+              networkSorted[3] == 3 && networkSorted[4] == 4 && networkSorted[5] == 7, "network_sorted");
+
+// the counts reach the sink once per call, and the instrumented quick sorts keep their recursion
+// O(log n) deep on the wrapped reversed shorts, whose many equal keys once defeated the pivots
+static void test_sort_metrics() {
+    std::vector<SortMetrics> calls;
+    CountingSortMetrics counting([&](const SortMetrics &metrics) { calls.push_back(metrics); });
+    std::vector<int> ints(100);
+    for (int i = 0; i < 100; i++) ints[i] = i;
+    bubble_sort(ints, std::less<int>(), counting);
+    CHECK(calls.size() == 1 && std::string(calls[0].algorithm) == "bubble_sort" && calls[0].size == 100);
+    CHECK(calls[0].comparisons == 99 && calls[0].swaps == 0 && calls[0].moves == 0);
+    std::mt19937 random(24);
+    for (int &value : ints) value = (int) (random() % 1000);
+    std::vector<int> expected = ints;
+    merge_sort(ints, std::less<int>(), counting);
+    CHECK(calls.size() == 2 && sorted_like(ints, expected));
+    CHECK(calls[1].comparisons > 0 && calls[1].comparisons <= 100 * 7);
+
+    const size_t n = 300000;
+    std::vector<short> shorts(n);
+    for (size_t i = 0; i < n; i++) shorts[i] = (short) (n - i);
+    std::vector<short> vector = shorts;
+    TimingSortMetrics timing;
+    quick_sort_extra(vector, std::less<short>(), timing);
+    CHECK(sorted_like(vector, shorts));
+    CHECK(timing.metrics().maxDepth <= 2 * 19);
+    CHECK(timing.metrics().partitions > 0 && timing.metrics().seconds > 0);
+    vector = shorts;
+    quick_sort_inplace(vector, std::less<short>(), timing);
+    CHECK(sorted_like(vector, shorts));
+    CHECK(timing.metrics().maxDepth <= 2 * 19);
+}
+
+int main() {
+    test_radix_sort_stable();
+    test_msd_radix_sort_tuples();
+    test_multikey_quick_sort_lcp();
+    test_merge_sort_signed_zero();
+    test_merge_sort_bottom_up_stable();
+    test_tim_sort_stable();
+    test_parallel_sample_sort();
+    test_quick_sort_extra_patterns();
+    test_external_sort();
+    test_multiway_merge();
+    test_sort_move_only();
+    test_argsort_permutation();
+    test_zip_sort_stable();
+    test_sort_by_key_stable();
+    test_select_nth_top_k();
+    test_adaptive_sort();
+    test_network_sort_signed_zero();
+    test_sort_metrics();
+    if (failures) {
+        std::cerr << failures << " checks failed" << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << "all checks passed" << std::endl;
+    return EXIT_SUCCESS;
+}
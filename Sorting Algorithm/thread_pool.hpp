@@ -0,0 +1,214 @@
+#ifndef VE281P1_THREAD_POOL_HPP
+#define VE281P1_THREAD_POOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * A work-stealing thread pool
+ * Every worker owns a deque: the owner pushes and pops at the back (LIFO, so
+ * the most recently forked and cache-hot subproblem runs first), idle workers
+ * steal from the front of other deques (FIFO, so they take the biggest pieces).
+ * A thread waiting for its tasks keeps running queued work (see runPending),
+ * so nested fork-join never deadlocks even with a single worker.
+ */
+class WorkStealingPool {
+public:
+    typedef std::function<void()> Task;
+
+    /**
+     * @param threadCount number of workers, 0 means hardware concurrency
+     */
+    explicit WorkStealingPool(size_t threadCount = 0) {
+        if (threadCount == 0) threadCount = std::thread::hardware_concurrency();
+        if (threadCount == 0) threadCount = 1;
+        for (size_t i = 0; i < threadCount; i++) {
+            workers.emplace_back(new Worker);
+        }
+        for (size_t i = 0; i < threadCount; i++) {
+            threads.emplace_back([this, i] { workerLoop(i); });
+        }
+    }
+
+    WorkStealingPool(const WorkStealingPool &) = delete;
+
+    WorkStealingPool &operator=(const WorkStealingPool &) = delete;
+
+    ~WorkStealingPool() {
+        {
+            std::lock_guard<std::mutex> guard(sleepLock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto &thread : threads) {
+            thread.join();
+        }
+    }
+
+    /**
+     * Queue a task, on the calling worker's own deque when called from inside the pool
+     * Time complexity: O(1)
+     */
+    void submit(Task task) {
+        ThreadState &state = local();
+        size_t index = state.pool == this ? state.index : next.fetch_add(1) % workers.size();
+        {
+            std::lock_guard<std::mutex> guard(workers[index]->lock);
+            workers[index]->tasks.push_back(std::move(task));
+        }
+        queued.fetch_add(1);
+        {
+            std::lock_guard<std::mutex> guard(sleepLock);
+        }
+        wake.notify_one();
+    }
+
+    /**
+     * Run one queued task on the calling thread
+     * @return whether a task was run
+     */
+    bool runPending() {
+        ThreadState &state = local();
+        Task task;
+        if (!take(state.pool == this ? state.index : next.fetch_add(1) % workers.size(), task)) return false;
+        task();
+        return true;
+    }
+
+    size_t size() const { return workers.size(); }
+
+    /**
+     * The process-wide pool used when a caller does not pass its own
+     */
+    static WorkStealingPool &shared() {
+        static WorkStealingPool pool;
+        return pool;
+    }
+
+private:
+    struct Worker {
+        std::mutex lock;
+        std::deque<Task> tasks;
+    };
+
+    struct ThreadState {
+        WorkStealingPool *pool = nullptr;
+        size_t index = 0;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> threads;
+    std::mutex sleepLock;
+    std::condition_variable wake;
+    std::atomic<size_t> queued{0};
+    std::atomic<size_t> next{0};
+    bool stopping = false;
+
+    static ThreadState &local() {
+        static thread_local ThreadState state;
+        return state;
+    }
+
+    // EFFECTS: pop from the back of our own deque, otherwise steal from the front of another one
+    bool take(size_t self, Task &task) {
+        if (queued.load() == 0) return false;
+        {
+            Worker &own = *workers[self];
+            std::lock_guard<std::mutex> guard(own.lock);
+            if (!own.tasks.empty()) {
+                task = std::move(own.tasks.back());
+                own.tasks.pop_back();
+                queued.fetch_sub(1);
+                return true;
+            }
+        }
+        for (size_t k = 1; k < workers.size(); k++) {
+            Worker &victim = *workers[(self + k) % workers.size()];
+            std::lock_guard<std::mutex> guard(victim.lock);
+            if (!victim.tasks.empty()) {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                queued.fetch_sub(1);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void workerLoop(size_t index) {
+        ThreadState &state = local();
+        state.pool = this;
+        state.index = index;
+        while (true) {
+            Task task;
+            if (take(index, task)) {
+                task();
+                continue;
+            }
+            std::unique_lock<std::mutex> guard(sleepLock);
+            wake.wait(guard, [this] { return stopping || queued.load() != 0; });
+            if (stopping && queued.load() == 0) return;
+        }
+    }
+};
+
+/**
+ * Fork-join helper on top of WorkStealingPool
+ * wait() helps running queued tasks instead of blocking, and rethrows the
+ * first exception thrown by any task of the group.
+ */
+class TaskGroup {
+public:
+    explicit TaskGroup(WorkStealingPool &pool) : pool(pool) {}
+
+    TaskGroup(const TaskGroup &) = delete;
+
+    TaskGroup &operator=(const TaskGroup &) = delete;
+
+    ~TaskGroup() {
+        while (pending.load() != 0) {
+            if (!pool.runPending()) std::this_thread::yield();
+        }
+    }
+
+    template<typename Function>
+    void run(Function function) {
+        pending.fetch_add(1);
+        pool.submit([this, function]() mutable {
+            try {
+                function();
+            } catch (...) {
+                std::lock_guard<std::mutex> guard(errorLock);
+                if (!error) error = std::current_exception();
+            }
+            pending.fetch_sub(1); // must stay the last access to this group
+        });
+    }
+
+    void wait() {
+        while (pending.load() != 0) {
+            if (!pool.runPending()) std::this_thread::yield();
+        }
+        if (error) {
+            std::exception_ptr e = error;
+            error = nullptr;
+            std::rethrow_exception(e);
+        }
+    }
+
+private:
+    WorkStealingPool &pool;
+    std::atomic<size_t> pending{0};
+    std::mutex errorLock;
+    std::exception_ptr error;
+};
+
+#endif //VE281P1_THREAD_POOL_HPP
@@ -3,6 +3,7 @@
 #include <algorithm>
 #include <cassert>
 #include <stdexcept>
+#include "Sorting Algorithm/sort.hpp"
 
 /**
  * An abstract template base of the KDTree class
@@ -395,13 +396,27 @@ protected:                      // DO NOT USE private HERE!
         return compareKey<DIM, Compare>(a.first, b.first);
     }
 
+    // EFFECTS: sort v by key with the in-place msd_radix_sort, so that no tuple comparison is made
+    //          while sorting, and keep the last pair of every group of equal keys like unique on the
+    //          reversed range below; keys are equal when the radix order cannot tell them apart
+    static void sort_unique(std::vector<std::pair<Key, Value>> &v) {
+        auto key = [](const std::pair<Key, Value> &a) -> const Key & { return a.first; };
+        msd_radix_less<decltype(key)> less{key};
+        msd_radix_sort(v, key);
+        auto last = std::unique(v.rbegin(), v.rend(), [&](const std::pair<Key, Value> &a,
+                                                          const std::pair<Key, Value> &b) {
+            return !less(a, b) && !less(b, a);
+        });
+        v.erase(v.begin(), last.base()); // remove duplicated elements
+    }
+
     // EFFECTS: helper function for explicit KDTree(std::vector<std::pair<Key, Value>> v)
     template<size_t DIM>
     void copy_from_vector(std::vector<std::pair<Key, Value>> v, Node* &node, Node* parent) {
         constexpr size_t DIM_NEXT = (DIM + 1) % KeySize;
         if (v.empty())
             return;
-        std::nth_element(v.begin(), v.begin() + (v.size() - 1)/2, v.end(), compareData<DIM, std::less<> >);
+        select_nth(v.begin(), v.begin() + (v.size() - 1)/2, v.end(), compareData<DIM, std::less<> >);
         insert<DIM>(v[(v.size() - 1)/2].first, v[(v.size() - 1)/2].second, node, parent);
         copy_from_vector<DIM_NEXT>(std::vector<std::pair<Key, Value>>(v.begin(), v.begin() + (v.size() - 1) / 2), node->left, node);
         copy_from_vector<DIM_NEXT>(std::vector<std::pair<Key, Value>>(v.begin() + (v.size() - 1) / 2 + 1, v.end()), node->right, node);
@@ -434,9 +449,13 @@ public:
      */
     explicit KDTree(std::vector<std::pair<Key, Value>> v) {
         // TODO: implement this function
-        std::stable_sort(v.begin(), v.end(), cmp<0>); // sort the vector by the order of key
-        auto last = std::unique(v.rbegin(), v.rend(), p);
-        v.erase(v.begin(), last.base()); // remove duplicated elements
+        if constexpr (radix_tuple<Key>::sortable) {
+            sort_unique(v);
+        } else {
+            std::stable_sort(v.begin(), v.end(), cmp<0>); // sort the vector by the order of key
+            auto last = std::unique(v.rbegin(), v.rend(), p);
+            v.erase(v.begin(), last.base()); // remove duplicated elements
+        }
         copy_from_vector<0>(v, root, nullptr);
     }
 